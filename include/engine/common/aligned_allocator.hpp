@@ -0,0 +1,56 @@
+#ifndef ALIGNEDALLOCATOR_H
+#define ALIGNEDALLOCATOR_H
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+// std::allocator compatible allocator returning memory aligned on Alignment bytes
+// used to make contiguous float arrays safe for aligned SIMD loads
+template<typename T, std::size_t Alignment>
+struct AlignedAllocator
+{
+	using value_type = T;
+
+	template<typename U>
+	struct rebind
+	{
+		using other = AlignedAllocator<U, Alignment>;
+	};
+
+	AlignedAllocator() = default;
+
+	template<typename U>
+	AlignedAllocator(const AlignedAllocator<U, Alignment>&)
+	{ }
+
+	T* allocate(std::size_t n)
+	{
+		return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t{ Alignment }));
+	}
+
+	void deallocate(T* p, std::size_t)
+	{
+		::operator delete(p, std::align_val_t{ Alignment });
+	}
+
+	template<typename U>
+	bool operator==(const AlignedAllocator<U, Alignment>&) const
+	{
+		return true;
+	}
+
+	template<typename U>
+	bool operator!=(const AlignedAllocator<U, Alignment>&) const
+	{
+		return false;
+	}
+};
+
+// cache line alignment also covers the widest SIMD register (AVX-512)
+constexpr std::size_t cache_line_size = 64;
+
+template<typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T, cache_line_size>>;
+
+#endif // !ALIGNEDALLOCATOR_H
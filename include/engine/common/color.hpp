@@ -0,0 +1,31 @@
+#ifndef COLOR_H
+#define COLOR_H
+
+#include <cstdint>
+
+// RGBA color of the simulation core, same layout as sf::Color
+struct Color
+{
+	uint8_t r = 0;
+	uint8_t g = 0;
+	uint8_t b = 0;
+	uint8_t a = 255;
+
+	constexpr Color() = default;
+
+	constexpr Color(uint8_t r_, uint8_t g_, uint8_t b_, uint8_t a_ = 255)
+		: r(r_), g(g_), b(b_), a(a_)
+	{ }
+};
+
+constexpr bool operator==(Color color_1, Color color_2)
+{
+	return color_1.r == color_2.r && color_1.g == color_2.g && color_1.b == color_2.b && color_1.a == color_2.a;
+}
+
+constexpr bool operator!=(Color color_1, Color color_2)
+{
+	return !(color_1 == color_2);
+}
+
+#endif // !COLOR_H
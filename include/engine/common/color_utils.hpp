@@ -1,25 +1,25 @@
 #ifndef COLORUTILS_H
 #define COLORUTILS_H
 
-#include <SFML/Graphics/Color.hpp>
+#include "color.hpp"
 #include "utils.hpp"
 #include "math.hpp"
 
 struct ColorUtils
 {
 	template<typename T>
-	static sf::Color createColor(T r, T g, T b)
+	static Color createColor(T r, T g, T b)
 	{
 		return { to<uint8_t>(r), to<uint8_t>(g), to<uint8_t>(b) };
 	}
 
 	template<typename TVec3>
-	static sf::Color createColor(TVec3 vec)
+	static Color createColor(TVec3 vec)
 	{
 		return { to<uint8_t>(vec.x), to<uint8_t>(vec.y), to<uint8_t>(vec.z) };
 	}
 
-	static sf::Color interpolate(sf::Color color_1, sf::Color color_2, float ratio)
+	static Color interpolate(Color color_1, Color color_2, float ratio)
 	{
 		return ColorUtils::createColor(
 			to<float>(color_1.r) + ratio * to<float>(color_2.r - color_1.r),
@@ -28,7 +28,7 @@ struct ColorUtils
 		);
 	}
 
-	static sf::Color getRainbow(float t)
+	static Color getRainbow(float t)
 	{
 		const float r = sin(t);
 		const float g = sin(t + 0.33f * 2.0f * Math::PI);
@@ -3,6 +3,8 @@
 
 #include <vector>
 #include <cstdint>
+#include <utility>
+#include <algorithm>
 
 namespace civ 
 {
@@ -87,7 +89,12 @@ namespace civ
 		void erase(ID id);
 		template<typename TPredicate>
 		void remove_if(TPredicate&& f);
+		// parallel version, TDispatcher provides dispatch(count, callback(start, end)) like tp::ThreadPool
+		template<typename TPredicate, typename TDispatcher>
+		void remove_if(TPredicate&& f, TDispatcher& dispatcher);
 		void clear();
+		// makes room for capacity objects without reallocating
+		void reserve(uint64_t capacity);
 
 		T& operator[](ID id);
 		const T& operator[](ID id) const;
@@ -118,6 +125,9 @@ namespace civ
 		ID getValidityID(ID id) const;
 
 	public:
+		// elements processed by one removal task
+		static constexpr uint64_t remove_chunk_size = 4096;
+
 		std::vector<T> data;
 		std::vector<uint64_t> ids;
 		std::vector<SlotMetadata> metadata;
@@ -339,6 +349,98 @@ namespace civ
 		}
 	}
 
+	// parallel equivalent of the erase swap pops, in fixed size chunks
+	// removed indices below the kept count (holes) are paired with kept indices above it (movers)
+	// swapping each pair leaves the kept objects in [0, kept count), returns the kept count
+	template<typename TDispatcher>
+	uint64_t computeRemoveSwaps(const std::vector<uint8_t>& removed, uint64_t count, uint64_t chunk_size,
+		std::vector<uint32_t>& holes, std::vector<uint32_t>& movers, TDispatcher& dispatcher)
+	{
+		const uint64_t chunk_count = (count + chunk_size - 1) / chunk_size;
+		// removed count before each chunk
+		std::vector<uint64_t> chunk_removed(chunk_count + 1, 0);
+		dispatcher.dispatch(static_cast<uint32_t>(chunk_count), [&](uint32_t start, uint32_t end) {
+			for (uint64_t c{start}; c < end; ++c)
+			{
+				const uint64_t last = std::min(count, (c + 1) * chunk_size);
+				for (uint64_t i{c * chunk_size}; i < last; ++i)
+				{
+					chunk_removed[c + 1] += removed[i];
+				}
+			}
+		});
+		for (uint64_t c{0}; c < chunk_count; ++c)
+		{
+			chunk_removed[c + 1] += chunk_removed[c];
+		}
+		const uint64_t kept_count = count - chunk_removed[chunk_count];
+		uint64_t holes_count = kept_count ? chunk_removed[kept_count / chunk_size] : 0;
+		for (uint64_t i{kept_count - kept_count % chunk_size}; i < kept_count; ++i)
+		{
+			holes_count += removed[i];
+		}
+		holes.resize(holes_count);
+		movers.resize(holes_count);
+		dispatcher.dispatch(static_cast<uint32_t>(chunk_count), [&](uint32_t start, uint32_t end) {
+			for (uint64_t c{start}; c < end; ++c)
+			{
+				const uint64_t first = c * chunk_size;
+				const uint64_t last = std::min(count, first + chunk_size);
+				uint64_t hole = chunk_removed[c];
+				// kept objects between kept_count and the chunk start
+				uint64_t mover = first > kept_count ? (first - kept_count) - (chunk_removed[c] - holes_count) : 0;
+				for (uint64_t i{first}; i < last; ++i)
+				{
+					if (i < kept_count && removed[i])
+					{
+						holes[hole++] = static_cast<uint32_t>(i);
+					}
+					else if (i >= kept_count && !removed[i])
+					{
+						movers[mover++] = static_cast<uint32_t>(i);
+					}
+				}
+			}
+		});
+		return kept_count;
+	}
+
+	template<typename T>
+	template<typename TPredicate, typename TDispatcher>
+	void Vector<T>::remove_if(TPredicate&& f, TDispatcher& dispatcher)
+	{
+		const uint64_t count = data_size;
+		std::vector<uint8_t> removed(count);
+		dispatcher.dispatch(static_cast<uint32_t>(count), [&](uint32_t start, uint32_t end) {
+			for (uint64_t i{start}; i < end; ++i)
+			{
+				removed[i] = f(data[i]);
+			}
+		});
+		std::vector<uint32_t> holes;
+		std::vector<uint32_t> movers;
+		const uint64_t kept_count = computeRemoveSwaps(removed, count, remove_chunk_size, holes, movers, dispatcher);
+		dispatcher.dispatch(static_cast<uint32_t>(holes.size()), [&](uint32_t start, uint32_t end) {
+			for (uint64_t i{start}; i < end; ++i)
+			{
+				std::swap(data[holes[i]], data[movers[i]]);
+				std::swap(metadata[holes[i]], metadata[movers[i]]);
+				ids[metadata[holes[i]].rid] = holes[i];
+				ids[metadata[movers[i]].rid] = movers[i];
+			}
+		});
+		// destroy the removed objects and invalidate their operations
+		dispatcher.dispatch(static_cast<uint32_t>(count - kept_count), [&](uint32_t start, uint32_t end) {
+			for (uint64_t i{kept_count + start}; i < kept_count + end; ++i)
+			{
+				data[i] = T{};
+				metadata[i].op_id = op_count + 1 + i - kept_count;
+			}
+		});
+		op_count += count - kept_count;
+		data_size = kept_count;
+	}
+
 	template<typename T>
 	ID Vector<T>::getNextId() const
 	{
@@ -365,6 +467,14 @@ namespace civ
 		data_size = 0;
 	}
 
+	template<typename T>
+	void Vector<T>::reserve(uint64_t capacity)
+	{
+		data.reserve(capacity);
+		ids.reserve(capacity);
+		metadata.reserve(capacity);
+	}
+
 	template<typename T>
 	template<typename TCallback>
 	void Vector<T>::foreach(TCallback&& callback)
@@ -0,0 +1,27 @@
+#ifndef SFMLUTILS_H
+#define SFMLUTILS_H
+
+#include <SFML/Graphics.hpp>
+#include "vec.hpp"
+#include "color.hpp"
+#include "utils.hpp"
+
+// conversions between the core types and SFML ones, only the windowed app depends on SFML
+
+template<typename T>
+sf::Vector2f toVector2f(sf::Vector2<T> v)
+{
+	return { to<float>(v.x), to<float>(v.y) };
+}
+
+inline sf::Vector2f toSf(Vec2 v)
+{
+	return { v.x, v.y };
+}
+
+inline sf::Color toSf(Color c)
+{
+	return { c.r, c.g, c.b, c.a };
+}
+
+#endif // !SFMLUTILS_H
@@ -2,8 +2,8 @@
 #define UTILS_H
 
 #include "index_vector.hpp"
-#include <SFML/Graphics.hpp>
 #include <sstream>
+#include <string>
 
 template<typename U, typename T>
 U to(const T& v)
@@ -29,10 +29,4 @@ static std::string toString(T value)
 	return sx.str();
 }
 
-template<typename T>
-sf::Vector2f toVector2f(sf::Vector2<T> v)
-{
-	return { to<float>(v.x), to<float>(v.y) };
-}
-
 #endif // !UTILS_H
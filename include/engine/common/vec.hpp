@@ -1,9 +1,108 @@
 #ifndef VEC_H
 #define VEC_H
 
-#include <SFML/System/Vector2.hpp>
+#include <cstdint>
 
-using Vec2 = sf::Vector2f;
-using IVec2 = sf::Vector2i;
+// 2D vector of the simulation core, same interface as sf::Vector2 so the core builds without SFML
+template<typename T>
+struct Vector2
+{
+	T x = 0;
+	T y = 0;
+
+	constexpr Vector2() = default;
+
+	constexpr Vector2(T x_, T y_)
+		: x(x_), y(y_)
+	{ }
+
+	template<typename U>
+	constexpr explicit Vector2(Vector2<U> v)
+		: x(static_cast<T>(v.x)), y(static_cast<T>(v.y))
+	{ }
+};
+
+template<typename T>
+constexpr Vector2<T> operator-(Vector2<T> v)
+{
+	return { -v.x, -v.y };
+}
+
+template<typename T>
+constexpr Vector2<T>& operator+=(Vector2<T>& v_1, Vector2<T> v_2)
+{
+	v_1.x += v_2.x;
+	v_1.y += v_2.y;
+	return v_1;
+}
+
+template<typename T>
+constexpr Vector2<T>& operator-=(Vector2<T>& v_1, Vector2<T> v_2)
+{
+	v_1.x -= v_2.x;
+	v_1.y -= v_2.y;
+	return v_1;
+}
+
+template<typename T>
+constexpr Vector2<T>& operator*=(Vector2<T>& v, T f)
+{
+	v.x *= f;
+	v.y *= f;
+	return v;
+}
+
+template<typename T>
+constexpr Vector2<T>& operator/=(Vector2<T>& v, T f)
+{
+	v.x /= f;
+	v.y /= f;
+	return v;
+}
+
+template<typename T>
+constexpr Vector2<T> operator+(Vector2<T> v_1, Vector2<T> v_2)
+{
+	return { v_1.x + v_2.x, v_1.y + v_2.y };
+}
+
+template<typename T>
+constexpr Vector2<T> operator-(Vector2<T> v_1, Vector2<T> v_2)
+{
+	return { v_1.x - v_2.x, v_1.y - v_2.y };
+}
+
+template<typename T>
+constexpr Vector2<T> operator*(Vector2<T> v, T f)
+{
+	return { v.x * f, v.y * f };
+}
+
+template<typename T>
+constexpr Vector2<T> operator*(T f, Vector2<T> v)
+{
+	return { v.x * f, v.y * f };
+}
+
+template<typename T>
+constexpr Vector2<T> operator/(Vector2<T> v, T f)
+{
+	return { v.x / f, v.y / f };
+}
+
+template<typename T>
+constexpr bool operator==(Vector2<T> v_1, Vector2<T> v_2)
+{
+	return v_1.x == v_2.x && v_1.y == v_2.y;
+}
+
+template<typename T>
+constexpr bool operator!=(Vector2<T> v_1, Vector2<T> v_2)
+{
+	return !(v_1 == v_2);
+}
+
+using Vec2 = Vector2<float>;
+using IVec2 = Vector2<int32_t>;
 
 #endif // !VEC_H
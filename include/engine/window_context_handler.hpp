@@ -4,7 +4,7 @@
 #include <SFML/Graphics.hpp>
 #include "render/viewport_handler.hpp"
 #include "common/event_manager.hpp"
-#include "common/utils.hpp"
+#include "common/sfml_utils.hpp"
 
 class WindowContextHandler;
 
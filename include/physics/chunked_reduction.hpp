@@ -0,0 +1,81 @@
+#ifndef CHUNKEDREDUCTION_H
+#define CHUNKEDREDUCTION_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "engine/common/utils.hpp"
+#include "thread_pool/thread_pool.hpp"
+
+// parallel reductions over fixed size chunks, their results do not depend on the threads count
+struct ChunkedReduction
+{
+	// elements processed by one max task, multiple of the SIMD width
+	static constexpr uint32_t max_chunk_size = 1024;
+	// elements processed by one prefix sum task
+	static constexpr uint32_t scan_chunk_size = 4096;
+
+	std::vector<float> chunk_max;
+	std::vector<uint32_t> chunk_offset;
+
+	// max of chunk_max_of(start, end) over the chunks of [0, count), 0 if count is 0
+	template<typename TChunkMax>
+	float getMax(uint32_t count, tp::ThreadPool& thread_pool, TChunkMax&& chunk_max_of)
+	{
+		const uint32_t chunk_count = (count + max_chunk_size - 1) / max_chunk_size;
+		chunk_max.resize(chunk_count);
+		thread_pool.dispatch(chunk_count, [&](uint32_t start, uint32_t end) {
+			for (uint32_t c{start}; c < end; ++c)
+			{
+				chunk_max[c] = chunk_max_of(c * max_chunk_size, std::min(count, (c + 1) * max_chunk_size));
+			}
+		});
+		float result = 0.0f;
+		for (const float value : chunk_max)
+		{
+			result = std::max(result, value);
+		}
+		return result;
+	}
+
+	// exclusive prefix sum of get(i) over [0, count), set(i, offset) receives the sum of the elements before i
+	// get(i) is read before set(i, offset) is called so both can use the same storage, returns the total
+	template<typename TGet, typename TSet>
+	uint32_t exclusiveScan(uint32_t count, tp::ThreadPool& thread_pool, TGet&& get, TSet&& set)
+	{
+		const uint32_t chunk_count = (count + scan_chunk_size - 1) / scan_chunk_size;
+		chunk_offset.resize(chunk_count + 1);
+		thread_pool.dispatch(chunk_count, [&](uint32_t start, uint32_t end) {
+			for (uint32_t c{start}; c < end; ++c)
+			{
+				const uint32_t last = std::min(count, (c + 1) * scan_chunk_size);
+				uint32_t sum = 0;
+				for (uint32_t i{c * scan_chunk_size}; i < last; ++i)
+				{
+					sum += get(i);
+				}
+				chunk_offset[c + 1] = sum;
+			}
+		});
+		chunk_offset[0] = 0;
+		for (uint32_t c{0}; c < chunk_count; ++c)
+		{
+			chunk_offset[c + 1] += chunk_offset[c];
+		}
+		thread_pool.dispatch(chunk_count, [&](uint32_t start, uint32_t end) {
+			for (uint32_t c{start}; c < end; ++c)
+			{
+				const uint32_t last = std::min(count, (c + 1) * scan_chunk_size);
+				uint32_t offset = chunk_offset[c];
+				for (uint32_t i{c * scan_chunk_size}; i < last; ++i)
+				{
+					const uint32_t value = get(i);
+					set(i, offset);
+					offset += value;
+				}
+			}
+		});
+		return chunk_offset[chunk_count];
+	}
+};
+#endif // !CHUNKEDREDUCTION_H
@@ -2,70 +2,294 @@
 #define COLLISIONGRID_H
 
 #include <cstdint>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include "chunked_reduction.hpp"
 #include "engine/common/vec.hpp"
-#include "engine/common/grid.hpp"
+#include "engine/common/utils.hpp"
+#include "thread_pool/thread_pool.hpp"
 
+// view on the atoms of one cell
 struct CollisionCell
 {
-	static constexpr uint8_t cell_capacity = 4;
-	static constexpr uint8_t max_cell_idx = cell_capacity - 1;
-
-	// overlap workaround
+	const uint32_t* objects = nullptr;
 	uint32_t objects_count = 0;
-	uint32_t objects[cell_capacity] = { };
+};
+
+// occupied part of a grid column
+struct GridColumn
+{
+	int32_t x;
+	int32_t first_row;
+	int32_t last_row;
+	uint32_t atoms_begin;
+	uint32_t atoms_end;
+};
+
+// geometry shared by the broadphase grids, cells are column major (index = x * height + y)
+// a grid only holds the atoms of its size class, radius in (min_radius, max_radius], with max_radius = cell_size / 2
+struct GridLayout
+{
+	static constexpr uint32_t invalid_cell = 0xFFFFFFFF;
+
+	int32_t width, height;
+	float cell_size;
+	float inv_cell_size;
+	// in cells, shifts the world origin away from the safety border
+	float offset;
+	float min_radius;
+	float max_radius;
+
+	GridLayout()
+		: GridLayout(0, 0, 1.0f, 0.0f, 0.0f)
+	{ }
 
-	CollisionCell() = default;
+	GridLayout(int32_t width_, int32_t height_, float cell_size_, float offset_, float min_radius_)
+		: width{ width_ }, height{ height_ },
+		cell_size{ cell_size_ }, inv_cell_size{ 1.0f / cell_size_ }, offset{ offset_ },
+		min_radius{ min_radius_ }, max_radius{ 0.5f * cell_size_ }
+	{ }
 
-	void addAtom(uint32_t id)
+	// cell_size wide cells covering a world of world_size units
+	// with one spare cell on each side so that atoms touching the world borders stay inside the safety border
+	static GridLayout createLevel(IVec2 world_size, float cell_size, float min_radius)
 	{
-		objects[objects_count] = id;
-		objects_count += objects_count < max_cell_idx;
+		const int32_t width = to<int32_t>(std::ceil(to<float>(world_size.x) / cell_size)) + 2;
+		const int32_t height = to<int32_t>(std::ceil(to<float>(world_size.y) / cell_size)) + 2;
+		return { width, height, cell_size, 1.0f, min_radius };
 	}
 
-	void clear()
+	[[nodiscard]]
+	bool holds(float radius) const
+	{
+		return radius > min_radius && radius <= max_radius;
+	}
+
+	// cell coordinates of a world position, not clamped
+	[[nodiscard]]
+	IVec2 getCellCoords(float x, float y) const
 	{
-		objects_count = 0u;
+		return { to<int32_t>(std::floor(x * inv_cell_size + offset)), to<int32_t>(std::floor(y * inv_cell_size + offset)) };
 	}
 
-	void remove(uint32_t id)
+	[[nodiscard]]
+	uint32_t getCellsCount() const
 	{
-		for (uint32_t i{ 0 }; i < objects_count; i++) 
+		return to<uint32_t>(width * height);
+	}
+
+	[[nodiscard]]
+	uint32_t getCellIndex(float x, float y) const
+	{
+		x = x * inv_cell_size + offset;
+		y = y * inv_cell_size + offset;
+		// safety border to avoid adding object outside the grid
+		if (x > 1.0f && x < to<float>(width) - 1.0f &&
+			y > 1.0f && y < to<float>(height) - 1.0f)
 		{
-			if (objects[i] == id)
-			{
-				// sawp pop
-				objects[i] = objects[objects_count - 1];
-				--objects_count;
-				return;
-			}
+			return to<uint32_t>(x) * height + to<uint32_t>(y);
 		}
+		return invalid_cell;
 	}
 };
 
-struct CollisionGrid : public Grid<CollisionCell>
+// dense uniform grid stored in CSR layout: the atoms of cell i are atoms[cell_start[i]] to atoms[cell_start[i + 1]]
+// cells hold any number of atoms
+struct CollisionGrid : public GridLayout
 {
-	CollisionGrid() :
-		Grid<CollisionCell>()
+	std::vector<uint32_t> cell_start;
+	std::vector<uint32_t> atoms;
+	// cell of each object, invalid_cell when outside of the grid safety border
+	std::vector<uint32_t> atom_cell;
+	// atoms count per cell during counting, then used as scatter cursors
+	std::vector<std::atomic<uint32_t>> cell_count;
+	ChunkedReduction reduction;
+
+	CollisionGrid() = default;
+
+	// unit cells covering the world, holds atoms with a radius up to 0.5
+	CollisionGrid(int32_t width_, int32_t height_)
+		: CollisionGrid(GridLayout{ width_, height_, 1.0f, 0.0f, 0.0f })
 	{ }
 
-	CollisionGrid(int32_t width, int32_t height) :
-		Grid<CollisionCell>(width, height)
+	explicit
+		CollisionGrid(const GridLayout& layout)
+		: GridLayout{ layout },
+		cell_start(to<size_t>(layout.width * layout.height) + 1, 0),
+		cell_count(to<size_t>(layout.width * layout.height))
 	{ }
 
-	bool addAtom(uint32_t x, uint32_t y, uint32_t atom)
+	static CollisionGrid createLevel(IVec2 world_size, float cell_size, float min_radius)
+	{
+		return CollisionGrid{ GridLayout::createLevel(world_size, cell_size, min_radius) };
+	}
+
+	[[nodiscard]]
+	CollisionCell getCell(uint32_t index) const
+	{
+		return { atoms.data() + cell_start[index], cell_start[index + 1] - cell_start[index] };
+	}
+
+	[[nodiscard]]
+	CollisionCell getCell(int32_t x, int32_t y) const
+	{
+		return getCell(to<uint32_t>(x * height + y));
+	}
+
+	// range of columns that can contain atoms
+	[[nodiscard]]
+	int32_t getColumnsBegin() const
+	{
+		return 1;
+	}
+
+	[[nodiscard]]
+	int32_t getColumnsEnd() const
+	{
+		return width - 1;
+	}
+
+	// calls callback(const GridColumn&) for each non empty column in [x_begin, x_end)
+	template<typename TCallback>
+	void forEachColumn(int32_t x_begin, int32_t x_end, TCallback&& callback) const
+	{
+		x_begin = std::max(x_begin, getColumnsBegin());
+		x_end = std::min(x_end, getColumnsEnd());
+		for (int32_t x{x_begin}; x < x_end; ++x)
+		{
+			const uint32_t column_begin = getColumnBegin(x);
+			const uint32_t column_end = getColumnEnd(x);
+			if (column_begin == column_end)
+			{
+				continue;
+			}
+			// atoms are sorted by cell so the first and last ones give the occupied rows
+			const int32_t column_first_cell = x * height;
+			const int32_t first_row = to<int32_t>(atom_cell[atoms[column_begin]]) - column_first_cell;
+			const int32_t last_row = to<int32_t>(atom_cell[atoms[column_end - 1]]) - column_first_cell;
+			callback(GridColumn{ x, first_row, last_row, column_begin, column_end });
+		}
+	}
+
+	// range of atoms of the whole column x
+	[[nodiscard]]
+	uint32_t getColumnBegin(int32_t x) const
+	{
+		return cell_start[x * height];
+	}
+
+	[[nodiscard]]
+	uint32_t getColumnEnd(int32_t x) const
 	{
-		const uint32_t id = x * height + y;
-		// add to grid
-		data[id].addAtom(atom);
-		return true;
+		return cell_start[(x + 1) * height];
 	}
 
 	void clear()
 	{
-		for (auto& c : data) 
+		std::fill(cell_start.begin(), cell_start.end(), 0);
+		atoms.clear();
+		atom_cell.clear();
+	}
+
+	// parallel counting sort of the objects of this grid size class into cells
+	void build(const float* position_x, const float* position_y, const float* radius, uint32_t objects_count, tp::ThreadPool& thread_pool)
+	{
+		beginBuild(objects_count, thread_pool);
+		thread_pool.dispatch(objects_count, [&](uint32_t start, uint32_t end) {
+			bin(position_x, position_y, radius, start, end);
+		});
+		endBuild(objects_count, thread_pool);
+	}
+
+	// build steps, bin can be called concurrently on disjoint ranges covering [0, objects_count)
+	// so that the binning can be fused with another pass over the objects
+	void beginBuild(uint32_t objects_count, tp::ThreadPool& thread_pool)
+	{
+		atom_cell.resize(objects_count);
+		// reset counters
+		thread_pool.dispatch(getCellsCount(), [&](uint32_t start, uint32_t end) {
+			for (uint32_t i{start}; i < end; ++i)
+			{
+				cell_count[i].store(0, std::memory_order_relaxed);
+			}
+		});
+	}
+
+	// count atoms per cell
+	void bin(const float* position_x, const float* position_y, const float* radius, uint32_t start, uint32_t end)
+	{
+		for (uint32_t i{start}; i < end; ++i)
 		{
-			c.objects_count = 0;
+			const uint32_t cell = holds(radius[i]) ? getCellIndex(position_x[i], position_y[i]) : invalid_cell;
+			atom_cell[i] = cell;
+			if (cell != invalid_cell)
+			{
+				cell_count[cell].fetch_add(1, std::memory_order_relaxed);
+			}
 		}
 	}
+
+	void endBuild(uint32_t objects_count, tp::ThreadPool& thread_pool)
+	{
+		computeCellStart(thread_pool);
+		// scatter atoms, counters become write cursors
+		thread_pool.dispatch(objects_count, [&](uint32_t start, uint32_t end) {
+			for (uint32_t i{start}; i < end; ++i)
+			{
+				const uint32_t cell = atom_cell[i];
+				if (cell != invalid_cell)
+				{
+					atoms[cell_count[cell].fetch_add(1, std::memory_order_relaxed)] = i;
+				}
+			}
+		});
+	}
+
+	// the scatter order of atoms depends on the threads, sorting each cell makes it reproducible
+	void sortCells(tp::ThreadPool& thread_pool)
+	{
+		thread_pool.dispatch(getCellsCount(), [&](uint32_t start, uint32_t end) {
+			for (uint32_t i{start}; i < end; ++i)
+			{
+				std::sort(atoms.begin() + cell_start[i], atoms.begin() + cell_start[i + 1]);
+			}
+		});
+	}
+
+	// follows a ParticleStore::reorder using the grid order (atoms first then objects outside of the grid)
+	// atoms become contiguous so the grid does not need to be rebuilt
+	void applyOrder(const std::vector<uint32_t>& order, tp::ThreadPool& thread_pool)
+	{
+		std::vector<uint32_t> new_atom_cell(atom_cell.size());
+		thread_pool.dispatch(to<uint32_t>(order.size()), [&](uint32_t start, uint32_t end) {
+			for (uint32_t i{start}; i < end; ++i)
+			{
+				new_atom_cell[i] = atom_cell[order[i]];
+			}
+		});
+		std::swap(atom_cell, new_atom_cell);
+		thread_pool.dispatch(to<uint32_t>(atoms.size()), [&](uint32_t start, uint32_t end) {
+			for (uint32_t i{start}; i < end; ++i)
+			{
+				atoms[i] = i;
+			}
+		});
+	}
+
+	// exclusive prefix sum of the counters, turns them into each cell's first slot
+	void computeCellStart(tp::ThreadPool& thread_pool)
+	{
+		const uint32_t cells_count = getCellsCount();
+		const uint32_t atoms_count = reduction.exclusiveScan(cells_count, thread_pool, [&](uint32_t i) {
+			return cell_count[i].load(std::memory_order_relaxed);
+		}, [&](uint32_t i, uint32_t offset) {
+			cell_start[i] = offset;
+			cell_count[i].store(offset, std::memory_order_relaxed);
+		});
+		cell_start[cells_count] = atoms_count;
+		atoms.resize(atoms_count);
+	}
 };
 #endif // !COLLISIONGRID_H
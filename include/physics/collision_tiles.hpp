@@ -0,0 +1,127 @@
+#ifndef COLLISIONTILES_H
+#define COLLISIONTILES_H
+
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "collision_grid.hpp"
+#include "particle_store.hpp"
+
+// 2D decomposition of the occupied part of a grid in square tiles, solved in four passes, one per color
+// a tile color is (x % 2, y % 2) so tiles of the same color are one tile apart and, tiles being at least
+// 2 cells wide, never write to the same cell
+struct CollisionTiles
+{
+	static constexpr int32_t min_tile_size = 2;
+	static constexpr int32_t max_tile_size = 64;
+	// tiles per color and per thread targeted by the automatic tile size, spare tiles balance the load
+	static constexpr int32_t tiles_per_thread = 4;
+
+	int32_t columns_begin = 0;
+	int32_t tile_size = min_tile_size;
+	int32_t tiles_x = 0;
+	int32_t tiles_y = 0;
+	std::vector<uint8_t> used;
+	// non empty tiles of each color
+	std::array<std::vector<uint32_t>, 4> colors;
+	// columns containing at least one awake atom
+	std::vector<uint8_t> column_awake;
+
+	// size 0 picks the tile size from the occupied area and the threads count
+	// solvers moving atoms farther than one cell away from their own need larger tiles, min_size gives the smallest
+	template<typename TGrid>
+	void update(const TGrid& grid, int32_t size, uint32_t thread_count, int32_t min_size = min_tile_size)
+	{
+		columns_begin = grid.getColumnsBegin();
+		const int32_t columns_count = std::max(grid.getColumnsEnd() - columns_begin, 0);
+		int32_t rows_begin = grid.height;
+		int32_t rows_end = 0;
+		grid.forEachColumn(columns_begin, columns_begin + columns_count, [&](const GridColumn& column) {
+			rows_begin = std::min(rows_begin, column.first_row);
+			rows_end = std::max(rows_end, column.last_row + 1);
+		});
+		if (!size)
+		{
+			const float occupied_area = to<float>(columns_count) * to<float>(std::max(rows_end - rows_begin, 0));
+			const float tiles_count = to<float>(4 * tiles_per_thread) * to<float>(thread_count);
+			size = to<int32_t>(std::sqrt(occupied_area / tiles_count));
+		}
+		tile_size = std::clamp(size, min_size, max_tile_size);
+		tiles_x = (columns_count + tile_size - 1) / tile_size;
+		tiles_y = (grid.height + tile_size - 1) / tile_size;
+		used.assign(to<size_t>(tiles_x * tiles_y), 0);
+		grid.forEachColumn(columns_begin, columns_begin + columns_count, [&](const GridColumn& column) {
+			const int32_t tile_x = (column.x - columns_begin) / tile_size;
+			for (int32_t tile_y{column.first_row / tile_size}; tile_y <= column.last_row / tile_size; ++tile_y)
+			{
+				used[tile_x * tiles_y + tile_y] = 1;
+			}
+		});
+		for (std::vector<uint32_t>& color : colors)
+		{
+			color.clear();
+		}
+		for (int32_t tile_x{0}; tile_x < tiles_x; ++tile_x)
+		{
+			for (int32_t tile_y{0}; tile_y < tiles_y; ++tile_y)
+			{
+				const uint32_t tile = to<uint32_t>(tile_x * tiles_y + tile_y);
+				if (used[tile])
+				{
+					colors[(tile_x & 1) * 2 + (tile_y & 1)].push_back(tile);
+				}
+			}
+		}
+	}
+
+	// first column and first row of a tile
+	[[nodiscard]]
+	IVec2 getOrigin(uint32_t tile) const
+	{
+		return { columns_begin + to<int32_t>(tile) / tiles_y * tile_size, to<int32_t>(tile) % tiles_y * tile_size };
+	}
+
+	template<typename TGrid>
+	void updateColumnAwake(const TGrid& grid, const ParticleStore& objects, float sleep_steps, tp::ThreadPool& thread_pool)
+	{
+		column_awake.assign(grid.width, 0);
+		const int32_t first_column = grid.getColumnsBegin();
+		const int32_t columns_count = grid.getColumnsEnd() - first_column;
+		thread_pool.dispatch(to<uint32_t>(std::max(columns_count, 0)), [&](uint32_t start, uint32_t end) {
+			grid.forEachColumn(first_column + to<int32_t>(start), first_column + to<int32_t>(end), [&](const GridColumn& column) {
+				uint8_t awake = 0;
+				for (uint32_t k{column.atoms_begin}; k < column.atoms_end && !awake; ++k)
+				{
+					awake = objects.isAwake(grid.atoms[k], sleep_steps);
+				}
+				column_awake[column.x] = awake;
+			});
+		});
+	}
+
+	// calls process(tile, task) for the tiles of each color in turn, task is in [0, threads count)
+	// tiles of a color are independent, threads grab them one at a time so that dense regions do not stall a pass
+	template<typename TCallback>
+	void forEachTileByColor(tp::ThreadPool& thread_pool, TCallback&& process) const
+	{
+		const uint32_t thread_count = thread_pool.thread_count_;
+		for (const std::vector<uint32_t>& color : colors)
+		{
+			std::atomic<uint32_t> next_tile{ 0 };
+			const uint32_t task_count = std::min(thread_count, to<uint32_t>(color.size()));
+			for (uint32_t t{0}; t < task_count; ++t)
+			{
+				thread_pool.addTask([&process, &color, &next_tile, t] {
+					for (uint32_t i{next_tile++}; i < color.size(); i = next_tile++)
+					{
+						process(color[i], t);
+					}
+				});
+			}
+			thread_pool.waitForCompletion();
+		}
+	}
+};
+#endif // !COLLISIONTILES_H
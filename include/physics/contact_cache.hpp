@@ -0,0 +1,272 @@
+#ifndef CONTACTCACHE_H
+#define CONTACTCACHE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "particle_store.hpp"
+#include "collision_grid.hpp"
+#include "engine/common/utils.hpp"
+#include "thread_pool/thread_pool.hpp"
+
+// candidate pairs of the unit grid kept across substeps, the 3x3 scan only runs again for the columns where an atom
+// has been added, removed or moved to another cell, the pairs of the other columns are exactly the ones it would find
+// a pair is stored once, in the column of its lowest cell, and only moves atoms of that column and of the next one
+// so the columns of a tile can be solved with the same colors as the grid
+// each contact keeps the distance it pushed its atoms apart during the last substep, a fraction of it is applied
+// again before solving as a warm start, then taken back by the solving passes if the atoms end up apart
+struct ContactCache
+{
+	struct Contact
+	{
+		uint32_t index_1;
+		uint32_t index_2;
+		// total push of the current substep
+		float push;
+		// part of the push coming from the warm start that has not been taken back yet
+		float warm;
+	};
+
+	// pairs owned by the atoms of a grid column, sorted by row
+	struct Column
+	{
+		int32_t first_row = 0;
+		// pairs of row first_row + i are contacts[row_start[i]] to contacts[row_start[i + 1]], empty for an empty column
+		std::vector<uint32_t> row_start;
+		std::vector<Contact> contacts;
+		// pairs before the last rebuild, searched for the pushes of the pairs found again
+		int32_t previous_first_row = 0;
+		std::vector<uint32_t> previous_row_start;
+		std::vector<Contact> previous_contacts;
+	};
+
+	static constexpr float response_coef = 1.0f;
+	static constexpr float eps = 0.0001f;
+
+	// fraction of the last substep push applied before solving, 0 disables the warm start
+	// objects velocities already carry the corrections of the last substep, in dense piles a warm start
+	// brought no gain and above one half it added energy, so it is off by default
+	float warm_start = 0.0f;
+	// solving passes over the pairs per substep, with a single one dense piles can heat up and explode
+	uint32_t iterations = 2;
+	std::vector<Column> columns;
+	// cell of each object when the pairs were last updated
+	std::vector<uint32_t> atom_cell;
+	std::vector<std::atomic<uint8_t>> column_dirty;
+
+	// finds the pairs again in the columns whose atoms changed since the last update
+	template<typename TGrid>
+	void update(const TGrid& grid, tp::ThreadPool& thread_pool)
+	{
+		const auto width = to<uint32_t>(grid.width);
+		if (columns.size() != width)
+		{
+			columns.clear();
+			columns.resize(width);
+			atom_cell.clear();
+			column_dirty = std::vector<std::atomic<uint8_t>>(width);
+			for (std::atomic<uint8_t>& dirty : column_dirty)
+			{
+				dirty.store(0, std::memory_order_relaxed);
+			}
+		}
+		markChangedColumns(grid, thread_pool);
+		thread_pool.dispatch(width, [&](uint32_t start, uint32_t end) {
+			for (uint32_t x{start}; x < end; ++x)
+			{
+				if (column_dirty[x].load(std::memory_order_relaxed))
+				{
+					buildColumn(grid, to<int32_t>(x));
+					column_dirty[x].store(0, std::memory_order_relaxed);
+				}
+			}
+		});
+	}
+
+	// applies the warm start of the pairs owned by rows [row_begin, row_end) of column x
+	void warmStartRows(ParticleStore& objects, int32_t x, int32_t row_begin, int32_t row_end)
+	{
+		const float* position_x = objects.position_x.data();
+		const float* position_y = objects.position_y.data();
+		const float* radius = objects.radius.data();
+		Column& column = columns[x];
+		const uint32_t end = getRowStart(column, row_end);
+		for (uint32_t i{getRowStart(column, row_begin)}; i < end; ++i)
+		{
+			Contact& contact = column.contacts[i];
+			if (contact.push == 0.0f)
+			{
+				continue;
+			}
+			const float o2_o1_x = position_x[contact.index_1] - position_x[contact.index_2];
+			const float o2_o1_y = position_y[contact.index_1] - position_y[contact.index_2];
+			const float dist2 = o2_o1_x * o2_o1_x + o2_o1_y * o2_o1_y;
+			contact.push *= dist2 > eps ? warm_start : 0.0f;
+			contact.warm = contact.push;
+			if (contact.push > 0.0f)
+			{
+				const float inv_dist = 1.0f / std::sqrt(dist2);
+				movePair(objects, radius, contact, o2_o1_x * inv_dist, o2_o1_y * inv_dist, contact.push);
+			}
+		}
+	}
+
+	// solves the pairs owned by rows [row_begin, row_end) of column x
+	// overlapping atoms are pushed apart, separated ones are pulled back by at most the remaining warm start
+	void solveRows(ParticleStore& objects, int32_t x, int32_t row_begin, int32_t row_end, bool first_pass)
+	{
+		const bool reset = first_pass && warm_start == 0.0f;
+		const float* position_x = objects.position_x.data();
+		const float* position_y = objects.position_y.data();
+		const float* radius = objects.radius.data();
+		Column& column = columns[x];
+		const uint32_t end = getRowStart(column, row_end);
+		for (uint32_t i{getRowStart(column, row_begin)}; i < end; ++i)
+		{
+			Contact& contact = column.contacts[i];
+			if (reset)
+			{
+				contact.push = 0.0f;
+				contact.warm = 0.0f;
+			}
+			const float o2_o1_x = position_x[contact.index_1] - position_x[contact.index_2];
+			const float o2_o1_y = position_y[contact.index_1] - position_y[contact.index_2];
+			const float dist2 = o2_o1_x * o2_o1_x + o2_o1_y * o2_o1_y;
+			const float min_dist = radius[contact.index_1] + radius[contact.index_2];
+			// most candidates are neither touching nor warm started
+			if ((contact.warm == 0.0f && dist2 >= min_dist * min_dist) || dist2 < eps)
+			{
+				continue;
+			}
+			const float dist = std::sqrt(dist2);
+			const float correction = std::max(response_coef * (min_dist - dist), -contact.warm);
+			contact.warm += std::min(correction, 0.0f);
+			contact.push += correction;
+			movePair(objects, radius, contact, o2_o1_x / dist, o2_o1_y / dist, correction);
+		}
+	}
+
+private:
+	// the distance is shared according to the masses
+	static void movePair(ParticleStore& objects, const float* radius, const Contact& contact, float normal_x, float normal_y, float distance)
+	{
+		const float mass_1 = radius[contact.index_1] * radius[contact.index_1];
+		const float mass_2 = radius[contact.index_2] * radius[contact.index_2];
+		const float delta = distance / (mass_1 + mass_2);
+		objects.displace(contact.index_1, normal_x * delta * mass_2, normal_y * delta * mass_2);
+		objects.displace(contact.index_2, -(normal_x * delta * mass_1), -(normal_y * delta * mass_1));
+	}
+
+	// first pair of a row, rows outside of the column are clamped to its ends
+	[[nodiscard]]
+	static uint32_t getRowStart(const Column& column, int32_t row)
+	{
+		if (column.row_start.empty())
+		{
+			return 0;
+		}
+		const int32_t rows_count = to<int32_t>(column.row_start.size()) - 1;
+		return column.row_start[std::clamp(row - column.first_row, 0, rows_count)];
+	}
+
+	// a pair depends on the cells of its two atoms, the column of the lowest one owns it
+	template<typename TGrid>
+	void markChangedColumns(const TGrid& grid, tp::ThreadPool& thread_pool)
+	{
+		const auto objects_count = to<uint32_t>(grid.atom_cell.size());
+		const auto previous_count = to<uint32_t>(atom_cell.size());
+		const uint32_t count = std::max(objects_count, previous_count);
+		atom_cell.resize(count, TGrid::invalid_cell);
+		thread_pool.dispatch(count, [&](uint32_t start, uint32_t end) {
+			for (uint32_t i{start}; i < end; ++i)
+			{
+				const uint32_t cell = i < objects_count ? grid.atom_cell[i] : TGrid::invalid_cell;
+				if (cell != atom_cell[i])
+				{
+					markCell(grid, atom_cell[i]);
+					markCell(grid, cell);
+					atom_cell[i] = cell;
+				}
+			}
+		});
+		atom_cell.resize(objects_count);
+	}
+
+	template<typename TGrid>
+	void markCell(const TGrid& grid, uint32_t cell)
+	{
+		if (cell == TGrid::invalid_cell)
+		{
+			return;
+		}
+		// atoms are never in the border columns
+		const uint32_t x = cell / to<uint32_t>(grid.height);
+		column_dirty[x].store(1, std::memory_order_relaxed);
+		column_dirty[x - 1].store(1, std::memory_order_relaxed);
+	}
+
+	// each atom is paired with the atoms after it in its cell, then with the ones of the cells after
+	// its own in column major order: below, and the three cells of the next column
+	template<typename TGrid>
+	void buildColumn(const TGrid& grid, int32_t x)
+	{
+		Column& column = columns[x];
+		std::swap(column.contacts, column.previous_contacts);
+		std::swap(column.row_start, column.previous_row_start);
+		column.previous_first_row = column.first_row;
+		column.contacts.clear();
+		column.row_start.clear();
+		grid.forEachColumn(x, x + 1, [&](const GridColumn& grid_column) {
+			column.first_row = grid_column.first_row;
+			for (int32_t y{grid_column.first_row}; y <= grid_column.last_row; ++y)
+			{
+				column.row_start.push_back(to<uint32_t>(column.contacts.size()));
+				const CollisionCell cell = grid.getCell(x, y);
+				for (uint32_t i{0}; i < cell.objects_count; ++i)
+				{
+					const uint32_t atom = cell.objects[i];
+					for (uint32_t k{i + 1}; k < cell.objects_count; ++k)
+					{
+						addContact(column, y, atom, cell.objects[k]);
+					}
+					addCell(column, y, atom, grid.getCell(x, y + 1));
+					addCell(column, y, atom, grid.getCell(x + 1, y - 1));
+					addCell(column, y, atom, grid.getCell(x + 1, y));
+					addCell(column, y, atom, grid.getCell(x + 1, y + 1));
+				}
+			}
+			column.row_start.push_back(to<uint32_t>(column.contacts.size()));
+		});
+	}
+
+	void addCell(Column& column, int32_t y, uint32_t atom, const CollisionCell& cell)
+	{
+		for (uint32_t i{0}; i < cell.objects_count; ++i)
+		{
+			addContact(column, y, atom, cell.objects[i]);
+		}
+	}
+
+	// the push is carried over if the pair was owned by the same row before the rebuild
+	void addContact(Column& column, int32_t y, uint32_t atom_1, uint32_t atom_2)
+	{
+		float push = 0.0f;
+		const int32_t row = y - column.previous_first_row;
+		if (row >= 0 && row + 1 < to<int32_t>(column.previous_row_start.size()))
+		{
+			for (uint32_t i{column.previous_row_start[row]}; i < column.previous_row_start[row + 1]; ++i)
+			{
+				const Contact& previous = column.previous_contacts[i];
+				if ((previous.index_1 == atom_1 && previous.index_2 == atom_2) || (previous.index_1 == atom_2 && previous.index_2 == atom_1))
+				{
+					push = previous.push;
+					break;
+				}
+			}
+		}
+		column.contacts.push_back({ atom_1, atom_2, push, 0.0f });
+	}
+};
+#endif // !CONTACTCACHE_H
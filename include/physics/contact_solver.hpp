@@ -0,0 +1,351 @@
+#ifndef CONTACTSOLVER_H
+#define CONTACTSOLVER_H
+
+#include "simd.hpp"
+#include "particle_store.hpp"
+#include "collision_grid.hpp"
+
+// local copy of the atoms of three consecutive grid columns, interleaved row by row
+// the 3x3 neighborhood of a cell of the middle column is then one contiguous range
+// works on any grid level since atoms two rows away are always further than their radius sum
+struct NeighborhoodBuffer
+{
+	// far enough to never collide while keeping its square finite
+	static constexpr float sentinel_position = 1.0e15f;
+
+	AlignedVector<float> position_x;
+	AlignedVector<float> position_y;
+	// only gathered for speculative contacts
+	AlignedVector<float> last_position_x;
+	AlignedVector<float> last_position_y;
+	AlignedVector<float> radius;
+	std::vector<uint32_t> atoms;
+	// index of the first atom of each row, row_start[height] is the atoms count
+	std::vector<uint32_t> row_start;
+	// range of the middle column atoms in each row
+	std::vector<uint32_t> center_begin;
+	std::vector<uint32_t> center_end;
+	// rows holding at least one awake atom, a cell only needs solving if an awake atom is around
+	std::vector<uint8_t> row_awake;
+	uint32_t first_row = 0;
+	uint32_t last_row = 0;
+	uint32_t count = 0;
+
+	void reserve(uint32_t capacity)
+	{
+		if (atoms.size() < capacity)
+		{
+			const uint32_t new_capacity = std::max(capacity, to<uint32_t>(atoms.size()) * 2);
+			position_x.resize(new_capacity);
+			position_y.resize(new_capacity);
+			last_position_x.resize(new_capacity);
+			last_position_y.resize(new_capacity);
+			radius.resize(new_capacity);
+			atoms.resize(new_capacity);
+		}
+	}
+
+	// returns true if the cell contains an awake atom
+	bool addCell(const ParticleStore& objects, const CollisionCell& c, float sleep_steps, bool speculative)
+	{
+		reserve(count + c.objects_count);
+		bool awake = false;
+		for (uint32_t i{0}; i < c.objects_count; ++i)
+		{
+			const uint32_t atom = c.objects[i];
+			atoms[count] = atom;
+			position_x[count] = objects.position_x[atom];
+			position_y[count] = objects.position_y[atom];
+			radius[count] = objects.radius[atom];
+			if (speculative)
+			{
+				const Vec2 last_position = objects.getLastPosition(atom);
+				last_position_x[count] = last_position.x;
+				last_position_y[count] = last_position.y;
+			}
+			awake |= objects.isAwake(atom, sleep_steps);
+			++count;
+		}
+		return awake;
+	}
+
+	// gathers rows [row_begin, row_end) of columns x - 1, x and x + 1, x has to be an inner column
+	template<typename TGrid>
+	void gather(const ParticleStore& objects, const TGrid& grid, int32_t x, uint32_t row_begin, uint32_t row_end, float sleep_steps, bool speculative)
+	{
+		const uint32_t height = to<uint32_t>(grid.height);
+		row_start.resize(height + 1);
+		center_begin.resize(height);
+		center_end.resize(height);
+		row_awake.resize(height);
+		first_row = row_begin;
+		last_row = row_end;
+		count = 0;
+		for (uint32_t y{row_begin}; y < row_end; ++y)
+		{
+			const int32_t row = to<int32_t>(y);
+			row_start[y] = count;
+			bool awake = addCell(objects, grid.getCell(x - 1, row), sleep_steps, speculative);
+			center_begin[y] = count;
+			awake |= addCell(objects, grid.getCell(x, row), sleep_steps, speculative);
+			center_end[y] = count;
+			awake |= addCell(objects, grid.getCell(x + 1, row), sleep_steps, speculative);
+			row_awake[y] = awake;
+		}
+		row_start[row_end] = count;
+		pad();
+	}
+
+	// sentinel lanes after the last atom so that ranges can be rounded up to the SIMD width
+	void pad()
+	{
+		reserve(count + simd::width);
+		for (uint32_t i{count}; i < count + simd::width; ++i)
+		{
+			position_x[i] = sentinel_position;
+			position_y[i] = sentinel_position;
+			last_position_x[i] = sentinel_position;
+			last_position_y[i] = sentinel_position;
+			radius[i] = 0.0f;
+		}
+	}
+
+	void scatter(ParticleStore& objects) const
+	{
+		for (uint32_t i{0}; i < count; ++i)
+		{
+			objects.displaceTo(atoms[i], position_x[i], position_y[i]);
+		}
+	}
+};
+
+// vectorized version of PhysicSolver::solveContact working on a NeighborhoodBuffer
+struct ContactSolver
+{
+	static constexpr float response_coef = 1.0f;
+	static constexpr float eps = 0.0001f;
+
+	// contact between an atom and a register of atoms, the correction to share is direction * scale
+	// regular contacts push overlapping atoms apart along o2_o1, with a scale of (min_dist - dist) / dist
+	// speculative ones use the atoms motion since their last positions, see getSpeculativeDepth
+	template<typename TFloat, bool speculative>
+	static typename TFloat::Mask getContact(TFloat o2_o1_x, TFloat o2_o1_y, TFloat start_x, TFloat start_y, TFloat min_dist,
+		TFloat& direction_x, TFloat& direction_y, TFloat& scale)
+	{
+		const TFloat one = TFloat::broadcast(1.0f);
+		const TFloat zero = TFloat::broadcast(0.0f);
+		const TFloat eps_v = TFloat::broadcast(eps);
+		const TFloat response = TFloat::broadcast(response_coef);
+		if constexpr (speculative)
+		{
+			const TFloat depth = getSpeculativeDepth(o2_o1_x, o2_o1_y, start_x, start_y, min_dist, direction_x, direction_y);
+			const typename TFloat::Mask colliding = greaterThan(depth, zero);
+			scale = select(colliding, response * depth, zero);
+			return colliding;
+		}
+		else
+		{
+			const TFloat dist2 = o2_o1_x * o2_o1_x + o2_o1_y * o2_o1_y;
+			const typename TFloat::Mask colliding = TFloat::maskAnd(lessThan(dist2, min_dist * min_dist), greaterThan(dist2, eps_v));
+			direction_x = o2_o1_x;
+			direction_y = o2_o1_y;
+			// computed without sqrt
+			scale = select(colliding, response * (min_dist * simd::invSqrt(dist2) - one), zero);
+			return colliding;
+		}
+	}
+
+	// both atoms are assumed to move in a straight line from their last positions, start is their relative last position
+	// pairs already touching at the start of the step are pushed apart along their current axis like regular contacts,
+	// the others along their axis at the time of impact, which also separates pairs that crossed each other
+	// returns the penetration depth along the normal, 0 or less for lanes without contact
+	template<typename TFloat>
+	static TFloat getSpeculativeDepth(TFloat o2_o1_x, TFloat o2_o1_y, TFloat start_x, TFloat start_y, TFloat min_dist,
+		TFloat& normal_x, TFloat& normal_y)
+	{
+		const TFloat zero = TFloat::broadcast(0.0f);
+		const TFloat eps_v = TFloat::broadcast(eps);
+		const TFloat min_dist2 = min_dist * min_dist;
+		const TFloat dist2 = o2_o1_x * o2_o1_x + o2_o1_y * o2_o1_y;
+		const TFloat inv_dist = simd::invSqrt(max(dist2, eps_v));
+		const TFloat overlap_depth = select(greaterThan(dist2, eps_v), min_dist - dist2 * inv_dist, zero);
+		// first t in [0, 1] where |start + t * move| = min_dist, (t * a) is the smallest root of a t^2 + 2 half_b t + c
+		const TFloat move_x = o2_o1_x - start_x;
+		const TFloat move_y = o2_o1_y - start_y;
+		const TFloat start2 = start_x * start_x + start_y * start_y;
+		const TFloat a = move_x * move_x + move_y * move_y;
+		const TFloat half_b = start_x * move_x + start_y * move_y;
+		const TFloat discriminant = half_b * half_b - a * (start2 - min_dist2);
+		const TFloat t_a = zero - half_b - sqrt(max(discriminant, zero));
+		const typename TFloat::Mask hit = TFloat::maskAnd(
+			TFloat::maskAnd(lessThan(half_b, zero), greaterThan(discriminant, zero)),
+			lessThan(t_a, a)
+		);
+		const TFloat t = t_a / max(a, eps_v);
+		const TFloat inv_min_dist = TFloat::broadcast(1.0f) / min_dist;
+		const TFloat impact_x = (start_x + move_x * t) * inv_min_dist;
+		const TFloat impact_y = (start_y + move_y * t) * inv_min_dist;
+		const TFloat impact_depth = select(hit, min_dist - (o2_o1_x * impact_x + o2_o1_y * impact_y), zero);
+		const typename TFloat::Mask touching = lessThan(start2, min_dist2);
+		normal_x = select(touching, o2_o1_x * inv_dist, impact_x);
+		normal_y = select(touching, o2_o1_y * inv_dist, impact_y);
+		return select(touching, overlap_depth, impact_depth);
+	}
+
+	// lanes of the register starting at buffer index k that are in [begin, end)
+	template<typename TFloat>
+	[[nodiscard]]
+	static typename TFloat::Mask getRangeMask(uint32_t k, uint32_t begin, uint32_t end)
+	{
+		const TFloat index = simd::laneIndices<TFloat>(k);
+		return TFloat::maskAnd(
+			greaterThan(index, TFloat::broadcast(to<float>(begin) - 0.5f)),
+			lessThan(index, TFloat::broadcast(to<float>(end) - 0.5f))
+		);
+	}
+
+	// solves the contacts between the atom at buffer index i and the atoms in [begin, end)
+	// corrections are applied to the buffer copy, the atom is moved by the sum of its own
+	template<typename TFloat, bool speculative = false>
+	static void solveAtom(NeighborhoodBuffer& buffer, uint32_t i, uint32_t begin, uint32_t end)
+	{
+		const TFloat one = TFloat::broadcast(1.0f);
+		const TFloat zero = TFloat::broadcast(0.0f);
+		const TFloat atom_x = TFloat::broadcast(buffer.position_x[i]);
+		const TFloat atom_y = TFloat::broadcast(buffer.position_y[i]);
+		const TFloat atom_last_x = TFloat::broadcast(speculative ? buffer.last_position_x[i] : 0.0f);
+		const TFloat atom_last_y = TFloat::broadcast(speculative ? buffer.last_position_y[i] : 0.0f);
+		const TFloat atom_radius = TFloat::broadcast(buffer.radius[i]);
+		const TFloat atom_mass = atom_radius * atom_radius;
+
+		TFloat correction_x = zero;
+		TFloat correction_y = zero;
+		float* position_x = buffer.position_x.data();
+		float* position_y = buffer.position_y.data();
+		const float* radius = buffer.radius.data();
+		// the range is widened to whole registers, extra lanes are atoms at least two rows away or sentinels
+		// so they can never overlap, speculative contacts come from the last positions and are masked instead
+		for (uint32_t k{begin - begin % TFloat::width}; k < end; k += TFloat::width)
+		{
+			const TFloat x = TFloat::load(position_x + k);
+			const TFloat y = TFloat::load(position_y + k);
+			const TFloat r = TFloat::load(radius + k);
+			const TFloat start_x = speculative ? atom_last_x - TFloat::load(buffer.last_position_x.data() + k) : zero;
+			const TFloat start_y = speculative ? atom_last_y - TFloat::load(buffer.last_position_y.data() + k) : zero;
+			TFloat direction_x;
+			TFloat direction_y;
+			TFloat scale;
+			typename TFloat::Mask colliding = getContact<TFloat, speculative>(atom_x - x, atom_y - y, start_x, start_y, atom_radius + r, direction_x, direction_y, scale);
+			if constexpr (speculative)
+			{
+				colliding = TFloat::maskAnd(colliding, getRangeMask<TFloat>(k, begin, end));
+				scale = select(colliding, scale, zero);
+			}
+			if (!TFloat::toBits(colliding))
+			{
+				continue;
+			}
+			// the overlap is shared according to the masses
+			const TFloat mass = r * r;
+			const TFloat inv_mass_sum = one / (atom_mass + mass);
+			const TFloat col_x = direction_x * scale * inv_mass_sum;
+			const TFloat col_y = direction_y * scale * inv_mass_sum;
+			correction_x = correction_x + col_x * mass;
+			correction_y = correction_y + col_y * mass;
+			(x - col_x * atom_mass).store(position_x + k);
+			(y - col_y * atom_mass).store(position_y + k);
+		}
+		position_x[i] += reduceAdd(correction_x);
+		position_y[i] += reduceAdd(correction_y);
+	}
+
+	// jacobi version of solveAtom, the buffer is left untouched and only the correction of the atom
+	// at buffer index i is returned, each pair is then solved twice, once from each side
+	template<typename TFloat, bool speculative = false>
+	[[nodiscard]]
+	static Vec2 getAtomCorrection(const NeighborhoodBuffer& buffer, uint32_t i, uint32_t begin, uint32_t end)
+	{
+		const TFloat zero = TFloat::broadcast(0.0f);
+		const TFloat atom_x = TFloat::broadcast(buffer.position_x[i]);
+		const TFloat atom_y = TFloat::broadcast(buffer.position_y[i]);
+		const TFloat atom_last_x = TFloat::broadcast(speculative ? buffer.last_position_x[i] : 0.0f);
+		const TFloat atom_last_y = TFloat::broadcast(speculative ? buffer.last_position_y[i] : 0.0f);
+		const TFloat atom_radius = TFloat::broadcast(buffer.radius[i]);
+		const TFloat atom_mass = atom_radius * atom_radius;
+
+		TFloat correction_x = zero;
+		TFloat correction_y = zero;
+		const float* position_x = buffer.position_x.data();
+		const float* position_y = buffer.position_y.data();
+		const float* radius = buffer.radius.data();
+		for (uint32_t k{begin - begin % TFloat::width}; k < end; k += TFloat::width)
+		{
+			const TFloat r = TFloat::load(radius + k);
+			const TFloat start_x = speculative ? atom_last_x - TFloat::load(buffer.last_position_x.data() + k) : zero;
+			const TFloat start_y = speculative ? atom_last_y - TFloat::load(buffer.last_position_y.data() + k) : zero;
+			TFloat direction_x;
+			TFloat direction_y;
+			TFloat scale;
+			typename TFloat::Mask colliding = getContact<TFloat, speculative>(
+				atom_x - TFloat::load(position_x + k), atom_y - TFloat::load(position_y + k),
+				start_x, start_y, atom_radius + r, direction_x, direction_y, scale
+			);
+			if constexpr (speculative)
+			{
+				colliding = TFloat::maskAnd(colliding, getRangeMask<TFloat>(k, begin, end));
+				scale = select(colliding, scale, zero);
+			}
+			if (!TFloat::toBits(colliding))
+			{
+				continue;
+			}
+			const TFloat mass = r * r;
+			const TFloat share = scale * mass / (atom_mass + mass);
+			correction_x = correction_x + direction_x * share;
+			correction_y = correction_y + direction_y * share;
+		}
+		return { reduceAdd(correction_x), reduceAdd(correction_y) };
+	}
+
+	// solves every cell of the middle column of the buffer, cells surrounded by sleeping atoms only are skipped
+	template<bool speculative = false>
+	static void solveColumn(NeighborhoodBuffer& buffer)
+	{
+		for (uint32_t y{buffer.first_row + 1}; y < buffer.last_row - 1; ++y)
+		{
+			if (!(buffer.row_awake[y - 1] | buffer.row_awake[y] | buffer.row_awake[y + 1]))
+			{
+				continue;
+			}
+			const uint32_t begin = buffer.row_start[y - 1];
+			const uint32_t end = buffer.row_start[y + 2];
+			for (uint32_t i{buffer.center_begin[y]}; i < buffer.center_end[y]; ++i)
+			{
+				solveAtom<simd::Float, speculative>(buffer, i, begin, end);
+			}
+		}
+	}
+
+	// jacobi version of solveColumn, the corrections of the middle column atoms are written to
+	// the correction arrays, each atom belonging to a single column no other thread writes them
+	template<bool speculative = false>
+	static void accumulateColumn(const NeighborhoodBuffer& buffer, float* correction_x, float* correction_y)
+	{
+		for (uint32_t y{buffer.first_row + 1}; y < buffer.last_row - 1; ++y)
+		{
+			if (!(buffer.row_awake[y - 1] | buffer.row_awake[y] | buffer.row_awake[y + 1]))
+			{
+				continue;
+			}
+			const uint32_t begin = buffer.row_start[y - 1];
+			const uint32_t end = buffer.row_start[y + 2];
+			for (uint32_t i{buffer.center_begin[y]}; i < buffer.center_end[y]; ++i)
+			{
+				const Vec2 correction = getAtomCorrection<simd::Float, speculative>(buffer, i, begin, end);
+				correction_x[buffer.atoms[i]] += correction.x;
+				correction_y[buffer.atoms[i]] += correction.y;
+			}
+		}
+	}
+};
+#endif // !CONTACTSOLVER_H
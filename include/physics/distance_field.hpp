@@ -0,0 +1,197 @@
+#ifndef DISTANCEFIELD_H
+#define DISTANCEFIELD_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "particle_store.hpp"
+#include "engine/common/math.hpp"
+#include "engine/common/utils.hpp"
+
+// static obstacles baked in a signed distance field, negative inside, sampled at the nodes of the unit collision grid
+// shapes are only evaluated when added, objects then collide with any geometry through a single bilinear lookup
+// obstacles thinner than a cell can leak, segments should be at least one unit thick
+struct DistanceField
+{
+	int32_t width;
+	int32_t height;
+	// distances are clamped to [-band, band], objects whose center is farther than band from obstacles are not affected
+	float band;
+	// (width + 1) * (height + 1) nodes, column major like the collision grid, empty until the first shape is added
+	std::vector<float> distance;
+
+	DistanceField(int32_t width_, int32_t height_, float band_ = 4.0f)
+		: width{ width_ },
+		height{ height_ },
+		band{ band_ }
+	{ }
+
+	[[nodiscard]]
+	bool empty() const
+	{
+		return distance.empty();
+	}
+
+	void clear()
+	{
+		distance.clear();
+	}
+
+	void addCircle(Vec2 center, float radius)
+	{
+		const Vec2 extent = { radius, radius };
+		addShape(center - extent, center + extent, [&](Vec2 p) {
+			return MathVec2::length(p - center) - radius;
+		});
+	}
+
+	// segment thickened by radius, a capsule
+	void addSegment(Vec2 a, Vec2 b, float radius)
+	{
+		const Vec2 extent = { radius, radius };
+		const Vec2 min_corner = { std::min(a.x, b.x), std::min(a.y, b.y) };
+		const Vec2 max_corner = { std::max(a.x, b.x), std::max(a.y, b.y) };
+		addShape(min_corner - extent, max_corner + extent, [&](Vec2 p) {
+			return getSegmentDistance(p, a, b) - radius;
+		});
+	}
+
+	// closed simple polygon, in any winding order
+	void addPolygon(const std::vector<Vec2>& points)
+	{
+		if (points.size() < 3)
+		{
+			return;
+		}
+		Vec2 min_corner = points[0];
+		Vec2 max_corner = points[0];
+		for (const Vec2 point : points)
+		{
+			min_corner = { std::min(min_corner.x, point.x), std::min(min_corner.y, point.y) };
+			max_corner = { std::max(max_corner.x, point.x), std::max(max_corner.y, point.y) };
+		}
+		addShape(min_corner, max_corner, [&](Vec2 p) {
+			// distance to the closest edge, the sign flips each time a ray going right crosses an edge
+			float min_dist = std::numeric_limits<float>::max();
+			bool inside = false;
+			for (uint64_t i{0}, j{points.size() - 1}; i < points.size(); j = i++)
+			{
+				const Vec2 v_i = points[i];
+				const Vec2 v_j = points[j];
+				min_dist = std::min(min_dist, getSegmentDistance(p, v_i, v_j));
+				if ((v_i.y > p.y) != (v_j.y > p.y) && p.x < v_i.x + (p.y - v_i.y) * (v_j.x - v_i.x) / (v_j.y - v_i.y))
+				{
+					inside = !inside;
+				}
+			}
+			return inside ? -min_dist : min_dist;
+		});
+	}
+
+	// bilinear interpolation, positions outside of the world are clamped to its borders
+	[[nodiscard]]
+	float getDistance(Vec2 position) const
+	{
+		if (empty())
+		{
+			return band;
+		}
+		return getSample(position.x, position.y).distance;
+	}
+
+	// pushes the objects overlapping obstacles out along the field gradient
+	void collide(ParticleStore& objects, uint64_t start, uint64_t end) const
+	{
+		constexpr float eps = 0.0001f;
+		const float* position_x = objects.position_x.data();
+		const float* position_y = objects.position_y.data();
+		const float* radius = objects.radius.data();
+		for (uint64_t i{start}; i < end; ++i)
+		{
+			const Sample sample = getSample(position_x[i], position_y[i]);
+			if (sample.distance >= radius[i])
+			{
+				continue;
+			}
+			const float gradient_length = std::sqrt(sample.gradient.x * sample.gradient.x + sample.gradient.y * sample.gradient.y);
+			// deep inside a large obstacle the clamped field is flat and gives no direction
+			if (gradient_length < eps)
+			{
+				continue;
+			}
+			const float push = (radius[i] - sample.distance) / gradient_length;
+			objects.displace(i, sample.gradient.x * push, sample.gradient.y * push);
+		}
+	}
+
+private:
+	struct Sample
+	{
+		float distance;
+		Vec2 gradient;
+	};
+
+	[[nodiscard]]
+	uint32_t getIndex(int32_t x, int32_t y) const
+	{
+		return to<uint32_t>(x * (height + 1) + y);
+	}
+
+	[[nodiscard]]
+	Sample getSample(float x, float y) const
+	{
+		const float clamped_x = std::clamp(x, 0.0f, to<float>(width));
+		const float clamped_y = std::clamp(y, 0.0f, to<float>(height));
+		const int32_t cell_x = std::min(to<int32_t>(clamped_x), width - 1);
+		const int32_t cell_y = std::min(to<int32_t>(clamped_y), height - 1);
+		const float t_x = clamped_x - to<float>(cell_x);
+		const float t_y = clamped_y - to<float>(cell_y);
+		const uint32_t index = getIndex(cell_x, cell_y);
+		const float d_00 = distance[index];
+		const float d_01 = distance[index + 1];
+		const float d_10 = distance[index + height + 1];
+		const float d_11 = distance[index + height + 2];
+		const float d_0 = d_00 + (d_01 - d_00) * t_y;
+		const float d_1 = d_10 + (d_11 - d_10) * t_y;
+		return {
+			d_0 + (d_1 - d_0) * t_x,
+			{ d_1 - d_0, (d_01 - d_00) + ((d_11 - d_10) - (d_01 - d_00)) * t_x }
+		};
+	}
+
+	[[nodiscard]]
+	static float getSegmentDistance(Vec2 p, Vec2 a, Vec2 b)
+	{
+		const Vec2 ab = b - a;
+		const Vec2 ap = p - a;
+		const float length2 = MathVec2::length2(ab);
+		const float t = length2 > 0.0f ? std::clamp(MathVec2::dot(ap, ab) / length2, 0.0f, 1.0f) : 0.0f;
+		return MathVec2::length(ap - ab * t);
+	}
+
+	// union of the shape with the current obstacles, only nodes closer than band to the shape bounds are evaluated
+	template<typename TCallback>
+	void addShape(Vec2 min_corner, Vec2 max_corner, TCallback&& shape_distance)
+	{
+		if (empty())
+		{
+			distance.assign(to<size_t>(width + 1) * to<size_t>(height + 1), band);
+		}
+		const int32_t x_begin = std::max(to<int32_t>(std::floor(min_corner.x - band)), 0);
+		const int32_t y_begin = std::max(to<int32_t>(std::floor(min_corner.y - band)), 0);
+		const int32_t x_end = std::min(to<int32_t>(std::ceil(max_corner.x + band)), width);
+		const int32_t y_end = std::min(to<int32_t>(std::ceil(max_corner.y + band)), height);
+		for (int32_t x{x_begin}; x <= x_end; ++x)
+		{
+			for (int32_t y{y_begin}; y <= y_end; ++y)
+			{
+				const float d = std::clamp(shape_distance(Vec2{ to<float>(x), to<float>(y) }), -band, band);
+				float& node = distance[getIndex(x, y)];
+				node = std::min(node, d);
+			}
+		}
+	}
+};
+#endif // !DISTANCEFIELD_H
@@ -0,0 +1,221 @@
+#ifndef DOMAINSOLVER_H
+#define DOMAINSOLVER_H
+
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <vector>
+#include "physics.hpp"
+#include "domain_transport.hpp"
+
+// split of the world in slabs along one axis, one per process
+struct DomainLayout
+{
+	// 0 for vertical slabs (split along x), 1 for horizontal ones
+	uint32_t axis;
+	uint32_t domain_count;
+	uint32_t rank;
+	// world size along the axis
+	float extent;
+
+	// the first and last domains extend to infinity so that every position has an owner
+	[[nodiscard]]
+	float getBegin() const
+	{
+		return rank ? extent * to<float>(rank) / to<float>(domain_count) : -std::numeric_limits<float>::max();
+	}
+
+	[[nodiscard]]
+	float getEnd() const
+	{
+		return rank + 1 < domain_count ? extent * to<float>(rank + 1) / to<float>(domain_count) : std::numeric_limits<float>::max();
+	}
+
+	[[nodiscard]]
+	float getCoordinate(Vec2 position) const
+	{
+		return axis ? position.y : position.x;
+	}
+};
+
+// one domain of a world simulated by several processes, each running its own solver on the whole world coordinates
+// every substep, objects that left the domain migrate to the neighbor domain, then objects close to a border
+// are sent to the neighbor as ghosts, temporary objects that collide with its own and are removed after the substep
+// a contact across a border is solved on both sides, each side only keeping the move of its own object
+// links between objects of different domains are not supported, long range forces only see the domain objects
+template<typename TGrid, typename TBroadphase = NeighborList>
+struct DomainSolver
+{
+	struct Ghost
+	{
+		float x;
+		float y;
+		float radius;
+	};
+
+	GenericPhysicSolver<TGrid, TBroadphase>& solver;
+	DomainLayout layout;
+	// transports to the domains of rank - 1 and rank + 1, null for the first and last domains
+	DomainTransport* previous;
+	DomainTransport* next;
+	uint32_t sub_steps = 8;
+	// objects closer than this to a border are sent as ghosts, at least two max radii
+	float halo_width = 2.0f;
+
+	std::vector<uint8_t> send_message;
+	std::vector<uint8_t> receive_message;
+	std::vector<PhysicObject> previous_migrants;
+	std::vector<PhysicObject> next_migrants;
+	std::vector<Ghost> previous_ghosts;
+	std::vector<Ghost> next_ghosts;
+	std::vector<civ::ID> removed_ids;
+	std::vector<civ::ID> ghost_ids;
+
+	static_assert(std::is_trivially_copyable_v<PhysicObject>, "migrants are sent as raw bytes");
+
+	// the local solver substeps are driven by the domain
+	DomainSolver(GenericPhysicSolver<TGrid, TBroadphase>& solver_, const DomainLayout& layout_, DomainTransport* previous_, DomainTransport* next_)
+		: solver{ solver_ },
+		layout{ layout_ },
+		previous{ previous_ },
+		next{ next_ }
+	{
+		solver.adaptive_sub_steps = false;
+	}
+
+	// the frame work (spatial sort, links, long range forces) only sees the domain objects, then each substep
+	// exchanges migrants and ghosts before solving
+	void update(float dt)
+	{
+		solver.sub_steps = sub_steps;
+		const float sub_dt = solver.beginFrame(dt);
+		for (uint32_t i(sub_steps); i--;)
+		{
+			exchangeMigrants();
+			exchangeGhosts();
+			solver.syncObjects();
+			solver.updateSubStep(sub_dt, false);
+			solver.removeObjects(ghost_ids);
+		}
+	}
+
+	[[nodiscard]]
+	bool isOwned(Vec2 position) const
+	{
+		const float coordinate = layout.getCoordinate(position);
+		return coordinate >= layout.getBegin() && coordinate < layout.getEnd();
+	}
+
+	void exchangeMigrants()
+	{
+		const float begin = layout.getBegin();
+		const float end = layout.getEnd();
+		previous_migrants.clear();
+		next_migrants.clear();
+		removed_ids.clear();
+		const float* coordinates = layout.axis ? solver.objects.position_y.data() : solver.objects.position_x.data();
+		for (uint64_t i{0}; i < solver.objects.size(); ++i)
+		{
+			if (coordinates[i] < begin || coordinates[i] >= end)
+			{
+				(coordinates[i] < begin ? previous_migrants : next_migrants).push_back(solver.objects.loadAt(i));
+				removed_ids.push_back(solver.objects.getID(i));
+			}
+		}
+		solver.removeObjects(removed_ids);
+		exchange(previous_migrants, next_migrants);
+		for (const std::vector<PhysicObject>* migrants : { &previous_migrants, &next_migrants })
+		{
+			for (const PhysicObject& object : *migrants)
+			{
+				solver.addObject(object);
+			}
+		}
+	}
+
+	void exchangeGhosts()
+	{
+		const float begin = layout.getBegin();
+		const float end = layout.getEnd();
+		previous_ghosts.clear();
+		next_ghosts.clear();
+		const float* position_x = solver.objects.position_x.data();
+		const float* position_y = solver.objects.position_y.data();
+		for (uint64_t i{0}; i < solver.objects.size(); ++i)
+		{
+			const float coordinate = layout.axis ? position_y[i] : position_x[i];
+			const Ghost ghost{ position_x[i], position_y[i], solver.objects.radius[i] };
+			if (previous && coordinate < begin + halo_width)
+			{
+				previous_ghosts.push_back(ghost);
+			}
+			if (next && coordinate >= end - halo_width)
+			{
+				next_ghosts.push_back(ghost);
+			}
+		}
+		exchange(previous_ghosts, next_ghosts);
+		ghost_ids.clear();
+		for (const std::vector<Ghost>* ghosts : { &previous_ghosts, &next_ghosts })
+		{
+			for (const Ghost& ghost : *ghosts)
+			{
+				ghost_ids.push_back(solver.createObject({ ghost.x, ghost.y }, ghost.radius));
+			}
+		}
+	}
+
+	// sends the items to the neighbors and replaces them by the ones received from them
+	// each border is handled by a pair of processes, the lower rank sends first so a pair never waits on itself
+	// borders with an even lower rank are handled first then the odd ones so that a chain never waits on itself
+	template<typename T>
+	void exchange(std::vector<T>& to_previous, std::vector<T>& to_next)
+	{
+		for (uint32_t parity{0}; parity < 2; ++parity)
+		{
+			if (previous && (layout.rank - 1) % 2 == parity)
+			{
+				previous->receive(receive_message);
+				pack(to_previous, send_message);
+				previous->send(send_message);
+				unpack(receive_message, to_previous);
+			}
+			if (next && layout.rank % 2 == parity)
+			{
+				pack(to_next, send_message);
+				next->send(send_message);
+				next->receive(receive_message);
+				unpack(receive_message, to_next);
+			}
+		}
+		if (!previous)
+		{
+			to_previous.clear();
+		}
+		if (!next)
+		{
+			to_next.clear();
+		}
+	}
+
+	template<typename T>
+	static void pack(const std::vector<T>& items, std::vector<uint8_t>& message)
+	{
+		message.resize(items.size() * sizeof(T));
+		if (!message.empty())
+		{
+			std::memcpy(message.data(), items.data(), message.size());
+		}
+	}
+
+	template<typename T>
+	static void unpack(const std::vector<uint8_t>& message, std::vector<T>& items)
+	{
+		items.resize(message.size() / sizeof(T));
+		if (!items.empty())
+		{
+			std::memcpy(items.data(), message.data(), items.size() * sizeof(T));
+		}
+	}
+};
+#endif // !DOMAINSOLVER_H
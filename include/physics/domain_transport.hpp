@@ -0,0 +1,415 @@
+#ifndef DOMAINTRANSPORT_H
+#define DOMAINTRANSPORT_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <stdexcept>
+#include "engine/common/utils.hpp"
+
+#if defined(__unix__)
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
+
+// bidirectional message channel between the processes of two neighbor domains
+// messages are delivered in order, receive blocks until a whole message is available
+struct DomainTransport
+{
+	virtual ~DomainTransport() = default;
+
+	virtual void send(const std::vector<uint8_t>& message) = 0;
+	virtual void receive(std::vector<uint8_t>& message) = 0;
+};
+
+#if defined(__unix__)
+// stream socket, either one end of a socketpair shared through fork or a Unix domain socket bound to a path
+struct SocketTransport : public DomainTransport
+{
+	int fd = -1;
+
+	explicit
+		SocketTransport(int fd_)
+		: fd{ fd_ }
+	{ }
+
+	SocketTransport(const SocketTransport&) = delete;
+	SocketTransport& operator=(const SocketTransport&) = delete;
+
+	~SocketTransport() override
+	{
+		if (fd >= 0)
+		{
+			close(fd);
+		}
+	}
+
+	// both ends of a connected pair, one is kept by each process after fork
+	static std::pair<int, int> createPair()
+	{
+		int fds[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+		{
+			throw std::runtime_error("socketpair failed");
+		}
+		return { fds[0], fds[1] };
+	}
+
+	// waits for the neighbor process to connect to path
+	static int listen(const std::string& path)
+	{
+		const sockaddr_un address = getAddress(path);
+		const int server = socket(AF_UNIX, SOCK_STREAM, 0);
+		unlink(path.c_str());
+		if (server < 0 ||
+			bind(server, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0 ||
+			::listen(server, 1) < 0)
+		{
+			throw std::runtime_error("cannot listen on " + path);
+		}
+		const int client = accept(server, nullptr, nullptr);
+		close(server);
+		unlink(path.c_str());
+		if (client < 0)
+		{
+			throw std::runtime_error("accept failed on " + path);
+		}
+		return client;
+	}
+
+	// retries until the neighbor process listens on path
+	static int connect(const std::string& path)
+	{
+		const sockaddr_un address = getAddress(path);
+		while (true)
+		{
+			const int client = socket(AF_UNIX, SOCK_STREAM, 0);
+			if (client < 0)
+			{
+				throw std::runtime_error("socket failed");
+			}
+			if (::connect(client, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0)
+			{
+				return client;
+			}
+			close(client);
+			std::this_thread::yield();
+		}
+	}
+
+	void send(const std::vector<uint8_t>& message) override
+	{
+		const uint64_t size = message.size();
+		write(&size, sizeof(size));
+		write(message.data(), message.size());
+	}
+
+	void receive(std::vector<uint8_t>& message) override
+	{
+		uint64_t size = 0;
+		read(&size, sizeof(size));
+		message.resize(size);
+		read(message.data(), size);
+	}
+
+private:
+	static sockaddr_un getAddress(const std::string& path)
+	{
+		sockaddr_un address{};
+		address.sun_family = AF_UNIX;
+		if (path.size() >= sizeof(address.sun_path))
+		{
+			throw std::runtime_error("socket path too long: " + path);
+		}
+		std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+		return address;
+	}
+
+	void write(const void* data, uint64_t size) const
+	{
+		const auto* bytes = static_cast<const uint8_t*>(data);
+		while (size)
+		{
+			const ssize_t written = ::send(fd, bytes, size, MSG_NOSIGNAL);
+			if (written < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (written <= 0)
+			{
+				throw std::runtime_error("domain socket send failed");
+			}
+			bytes += written;
+			size -= to<uint64_t>(written);
+		}
+	}
+
+	void read(void* data, uint64_t size) const
+	{
+		auto* bytes = static_cast<uint8_t*>(data);
+		while (size)
+		{
+			const ssize_t received = ::recv(fd, bytes, size, 0);
+			if (received < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (received <= 0)
+			{
+				throw std::runtime_error("domain socket receive failed");
+			}
+			bytes += received;
+			size -= to<uint64_t>(received);
+		}
+	}
+};
+
+// two single slot mailboxes, one per direction, in a POSIX shared memory segment
+// messages larger than a mailbox are sent in several chunks
+// a segment left under the same name by a previous run is never used: the side opening the segment writes a token
+// in its header and only uses it once the owner has echoed that token
+struct SharedMemoryTransport : public DomainTransport
+{
+	static constexpr uint64_t default_capacity = 1 << 22;
+
+	struct Header
+	{
+		// written by the side opening the segment, 0 until it has attached
+		std::atomic<uint64_t> peer_token;
+		// the peer token echoed by the owner
+		std::atomic<uint64_t> owner_token;
+	};
+
+	struct Mailbox
+	{
+		// the mailbox holds a chunk while full is set, the writer waits for the reader to clear it
+		std::atomic<uint32_t> full;
+		uint64_t message_size;
+		uint64_t chunk_size;
+	};
+
+	std::string name;
+	uint64_t capacity;
+	bool owner;
+	uint8_t* segment = nullptr;
+	Header* header = nullptr;
+	Mailbox* outbox = nullptr;
+	Mailbox* inbox = nullptr;
+
+	// the owner creates the segment, the other side opens it, each uses the opposite mailbox
+	SharedMemoryTransport(const std::string& name_, bool owner_, uint64_t capacity_ = default_capacity)
+		: name{ name_ }, capacity{ capacity_ }, owner{ owner_ }
+	{
+		if (owner)
+		{
+			create();
+		}
+		else
+		{
+			attach();
+		}
+		Mailbox* first = getMailbox(0);
+		Mailbox* second = getMailbox(1);
+		outbox = owner ? first : second;
+		inbox = owner ? second : first;
+	}
+
+	SharedMemoryTransport(const SharedMemoryTransport&) = delete;
+	SharedMemoryTransport& operator=(const SharedMemoryTransport&) = delete;
+
+	~SharedMemoryTransport() override
+	{
+		munmap(segment, getSegmentSize());
+		if (owner)
+		{
+			shm_unlink(name.c_str());
+		}
+	}
+
+	void send(const std::vector<uint8_t>& message) override
+	{
+		uint64_t sent = 0;
+		do
+		{
+			wait(*outbox, 0);
+			const uint64_t chunk = std::min(capacity, message.size() - sent);
+			outbox->message_size = message.size();
+			outbox->chunk_size = chunk;
+			// empty messages are sent as a single empty chunk
+			if (chunk)
+			{
+				std::memcpy(getData(outbox), message.data() + sent, chunk);
+			}
+			outbox->full.store(1, std::memory_order_release);
+			sent += chunk;
+		}
+		while (sent < message.size());
+	}
+
+	void receive(std::vector<uint8_t>& message) override
+	{
+		uint64_t received = 0;
+		do
+		{
+			wait(*inbox, 1);
+			message.resize(inbox->message_size);
+			if (inbox->chunk_size)
+			{
+				std::memcpy(message.data() + received, getData(inbox), inbox->chunk_size);
+			}
+			received += inbox->chunk_size;
+			inbox->full.store(0, std::memory_order_release);
+		}
+		while (received < message.size());
+	}
+
+private:
+	// keeps the mailboxes headers aligned
+	static constexpr uint64_t header_size = (sizeof(Header) + 63) / 64 * 64;
+
+	[[nodiscard]]
+	uint64_t getMailboxSize() const
+	{
+		return (sizeof(Mailbox) + capacity + 63) / 64 * 64;
+	}
+
+	[[nodiscard]]
+	uint64_t getSegmentSize() const
+	{
+		return header_size + 2 * getMailboxSize();
+	}
+
+	Mailbox* getMailbox(uint32_t i) const
+	{
+		return reinterpret_cast<Mailbox*>(segment + header_size + i * getMailboxSize());
+	}
+
+	void map(int fd)
+	{
+		void* memory = mmap(nullptr, getSegmentSize(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (memory == MAP_FAILED)
+		{
+			close(fd);
+			throw std::runtime_error("cannot map shared memory " + name);
+		}
+		segment = static_cast<uint8_t*>(memory);
+		header = reinterpret_cast<Header*>(segment);
+	}
+
+	// a new segment is zero filled so both mailboxes start empty, waits for the peer to attach then echoes its token
+	void create()
+	{
+		shm_unlink(name.c_str());
+		const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+		if (fd < 0 || ftruncate(fd, to<off_t>(getSegmentSize())) < 0)
+		{
+			if (fd >= 0)
+			{
+				close(fd);
+			}
+			throw std::runtime_error("cannot create shared memory " + name);
+		}
+		map(fd);
+		close(fd);
+		uint64_t token = 0;
+		while (!(token = header->peer_token.load(std::memory_order_acquire)))
+		{
+			std::this_thread::yield();
+		}
+		header->owner_token.store(token, std::memory_order_release);
+	}
+
+	// the segment opened may be a stale one about to be replaced by the owner, it is dropped once the name refers
+	// to another segment and the handshake restarts on the new one
+	void attach()
+	{
+		const uint64_t token = createToken();
+		while (true)
+		{
+			const int fd = openSegment();
+			map(fd);
+			header->peer_token.store(token, std::memory_order_release);
+			bool replaced = false;
+			while (header->owner_token.load(std::memory_order_acquire) != token && !(replaced = isReplaced(fd)))
+			{
+				std::this_thread::yield();
+			}
+			close(fd);
+			if (!replaced)
+			{
+				return;
+			}
+			munmap(segment, getSegmentSize());
+		}
+	}
+
+	// unique across the processes of a run and across runs
+	[[nodiscard]]
+	static uint64_t createToken()
+	{
+		const auto time = to<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+		return ((to<uint64_t>(getpid()) << 40) ^ time) | 1;
+	}
+
+	// true if the name now refers to another segment than the one opened as fd
+	[[nodiscard]]
+	bool isReplaced(int fd) const
+	{
+		const int current = shm_open(name.c_str(), O_RDONLY, 0600);
+		if (current < 0)
+		{
+			return false;
+		}
+		struct stat opened{};
+		struct stat named{};
+		const bool replaced = fstat(fd, &opened) == 0 && fstat(current, &named) == 0 &&
+			(opened.st_ino != named.st_ino || opened.st_dev != named.st_dev);
+		close(current);
+		return replaced;
+	}
+
+	static uint8_t* getData(Mailbox* mailbox)
+	{
+		return reinterpret_cast<uint8_t*>(mailbox + 1);
+	}
+
+	// retries until the owner has created and sized the segment
+	int openSegment() const
+	{
+		while (true)
+		{
+			const int fd = shm_open(name.c_str(), O_RDWR, 0600);
+			struct stat status{};
+			if (fd >= 0 && fstat(fd, &status) == 0 && to<uint64_t>(status.st_size) >= getSegmentSize())
+			{
+				return fd;
+			}
+			if (fd >= 0)
+			{
+				close(fd);
+			}
+			std::this_thread::yield();
+		}
+	}
+
+	static void wait(const Mailbox& mailbox, uint32_t state)
+	{
+		while (mailbox.full.load(std::memory_order_acquire) != state)
+		{
+			std::this_thread::yield();
+		}
+	}
+};
+#endif
+#endif // !DOMAINTRANSPORT_H
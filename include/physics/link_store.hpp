@@ -0,0 +1,232 @@
+#ifndef LINKSTORE_H
+#define LINKSTORE_H
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include "particle_store.hpp"
+#include "engine/common/index_vector.hpp"
+#include "thread_pool/thread_pool.hpp"
+
+// distance constraints between objects, used to build ropes, cloth and soft bodies
+// links are greedily colored so that no two links of a color share an object, each color is then solved in parallel
+struct LinkStore
+{
+	// colors are tracked per object in a 64 bits mask, links of objects with more neighbors go to an extra serial batch
+	static constexpr uint32_t max_colors = 64;
+
+	struct Link
+	{
+		civ::ID object_1;
+		civ::ID object_2;
+		// objects validity ids, links to erased objects are dropped
+		civ::ID validity_1;
+		civ::ID validity_2;
+		float length;
+		// fraction of the length error corrected per substep, in (0, 1]
+		float stiffness;
+	};
+
+	// links resolved to data indices for the current frame
+	struct SolverLink
+	{
+		uint32_t index_1;
+		uint32_t index_2;
+		float length;
+		float stiffness;
+	};
+
+	civ::Vector<Link> links;
+	// link data indices grouped by color, links of color c are colored[color_start[c]] to colored[color_start[c + 1]]
+	std::vector<uint32_t> colored;
+	std::vector<uint32_t> color_start = { 0 };
+	std::vector<SolverLink> solver_links;
+	bool colors_outdated = false;
+	// coloring buffers
+	std::vector<uint64_t> object_colors;
+	std::vector<uint32_t> link_color;
+
+	// the rest length is the current distance between the objects
+	civ::ID createLink(const ParticleStore& objects, civ::ID object_1, civ::ID object_2, float stiffness = 1.0f)
+	{
+		colors_outdated = true;
+		const Vec2 delta = objects.getPosition(objects.getDataID(object_1)) - objects.getPosition(objects.getDataID(object_2));
+		return links.emplace_back(Link{
+			object_1, object_2,
+			objects.getValidityID(object_1), objects.getValidityID(object_2),
+			MathVec2::length(delta), stiffness
+		});
+	}
+
+	void createLinks(const ParticleStore& objects, const std::vector<std::pair<civ::ID, civ::ID>>& pairs, float stiffness = 1.0f)
+	{
+		links.reserve(links.size() + pairs.size());
+		for (const std::pair<civ::ID, civ::ID>& pair : pairs)
+		{
+			createLink(objects, pair.first, pair.second, stiffness);
+		}
+	}
+
+	void erase(civ::ID id)
+	{
+		colors_outdated = true;
+		links.erase(id);
+	}
+
+	void clear()
+	{
+		colors_outdated = true;
+		links.clear();
+	}
+
+	[[nodiscard]]
+	uint64_t size() const
+	{
+		return links.size();
+	}
+
+	// to call once per frame, before solving, after objects have been added, erased or reordered
+	void update(const ParticleStore& objects, tp::ThreadPool& thread_pool)
+	{
+		if (!links.size() && !colors_outdated)
+		{
+			return;
+		}
+		removeInvalidLinks(objects, thread_pool);
+		if (colors_outdated)
+		{
+			updateColors(objects);
+			colors_outdated = false;
+		}
+		// data indices change with objects erase and reorder, ids do not
+		solver_links.resize(colored.size());
+		thread_pool.dispatch(to<uint32_t>(colored.size()), [&](uint32_t start, uint32_t end) {
+			for (uint32_t i{start}; i < end; ++i)
+			{
+				const Link& link = links.data[colored[i]];
+				solver_links[i] = {
+					to<uint32_t>(objects.getDataID(link.object_1)),
+					to<uint32_t>(objects.getDataID(link.object_2)),
+					link.length, link.stiffness
+				};
+			}
+		});
+	}
+
+	// one parallel pass per color, the overflow batch is solved by the calling thread
+	void solve(ParticleStore& objects, tp::ThreadPool& thread_pool) const
+	{
+		const uint32_t colors_count = to<uint32_t>(color_start.size()) - 1;
+		for (uint32_t color{0}; color < colors_count; ++color)
+		{
+			const uint32_t first = color_start[color];
+			const uint32_t count = color_start[color + 1] - first;
+			if (color == max_colors)
+			{
+				solveRange(objects, first, first + count);
+				continue;
+			}
+			thread_pool.dispatch(count, [&](uint32_t start, uint32_t end) {
+				solveRange(objects, first + start, first + end);
+			});
+		}
+	}
+
+	// same mass weighting as the contacts, links are only pulled along their axis
+	void solveRange(ParticleStore& objects, uint32_t start, uint32_t end) const
+	{
+		constexpr float eps = 0.0001f;
+		const float* position_x = objects.position_x.data();
+		const float* position_y = objects.position_y.data();
+		const float* radius = objects.radius.data();
+		for (uint32_t i{start}; i < end; ++i)
+		{
+			const SolverLink& link = solver_links[i];
+			const Vec2 o2_o1 = { position_x[link.index_1] - position_x[link.index_2], position_y[link.index_1] - position_y[link.index_2] };
+			const float dist2 = o2_o1.x * o2_o1.x + o2_o1.y * o2_o1.y;
+			if (dist2 < eps)
+			{
+				continue;
+			}
+			const float dist = sqrt(dist2);
+			const float mass_1 = radius[link.index_1] * radius[link.index_1];
+			const float mass_2 = radius[link.index_2] * radius[link.index_2];
+			const float delta = link.stiffness * (link.length - dist) / (mass_1 + mass_2);
+			const Vec2 col_vec = (o2_o1 / dist) * delta;
+			objects.displace(link.index_1, col_vec.x * mass_2, col_vec.y * mass_2);
+			objects.displace(link.index_2, -col_vec.x * mass_1, -col_vec.y * mass_1);
+		}
+	}
+
+private:
+	void removeInvalidLinks(const ParticleStore& objects, tp::ThreadPool& thread_pool)
+	{
+		std::atomic<bool> found{ false };
+		thread_pool.dispatch(to<uint32_t>(links.size()), [&](uint32_t start, uint32_t end) {
+			for (uint32_t i{start}; i < end && !found; ++i)
+			{
+				if (!isValid(objects, links.data[i]))
+				{
+					found = true;
+				}
+			}
+		});
+		if (found)
+		{
+			links.remove_if([&](const Link& link) { return !isValid(objects, link); }, thread_pool);
+			colors_outdated = true;
+		}
+	}
+
+	[[nodiscard]]
+	static bool isValid(const ParticleStore& objects, const Link& link)
+	{
+		return objects.isValid(link.object_1, link.validity_1) && objects.isValid(link.object_2, link.validity_2);
+	}
+
+	// greedy coloring, each link takes the first color unused by the links of its two objects
+	void updateColors(const ParticleStore& objects)
+	{
+		const uint32_t links_count = to<uint32_t>(links.size());
+		object_colors.assign(objects.ids.size(), 0);
+		link_color.resize(links_count);
+		color_start.assign(max_colors + 2, 0);
+		for (uint32_t i{0}; i < links_count; ++i)
+		{
+			const Link& link = links.data[i];
+			const uint64_t used = object_colors[link.object_1] | object_colors[link.object_2];
+			uint32_t color = 0;
+			while (color < max_colors && (used >> color) & 1)
+			{
+				++color;
+			}
+			if (color < max_colors)
+			{
+				object_colors[link.object_1] |= uint64_t{ 1 } << color;
+				object_colors[link.object_2] |= uint64_t{ 1 } << color;
+			}
+			link_color[i] = color;
+			++color_start[color + 1];
+		}
+		// counting sort of the links by color
+		uint32_t colors_count = 0;
+		for (uint32_t color{0}; color <= max_colors; ++color)
+		{
+			if (color_start[color + 1])
+			{
+				colors_count = color + 1;
+			}
+			color_start[color + 1] += color_start[color];
+		}
+		colored.resize(links_count);
+		std::vector<uint32_t> cursor(color_start.begin(), color_start.end() - 1);
+		for (uint32_t i{0}; i < links_count; ++i)
+		{
+			colored[cursor[link_color[i]]++] = i;
+		}
+		// only keep the used colors, the overflow batch stays last
+		color_start.resize(colors_count + 1);
+	}
+};
+#endif // !LINKSTORE_H
@@ -0,0 +1,390 @@
+#ifndef LONGRANGEFORCES_H
+#define LONGRANGEFORCES_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "particle_store.hpp"
+#include "radix_sort.hpp"
+#include "engine/common/aligned_allocator.hpp"
+#include "engine/common/utils.hpp"
+#include "thread_pool/thread_pool.hpp"
+
+// mutual attraction between objects and fixed point attractors, evaluated once per frame
+// the mutual part uses a Barnes-Hut quadtree: far enough nodes act as a single mass at their center of mass
+// the tree is built from the objects sorted along a Morton curve, the top levels serially then the subtrees in parallel
+// masses are radius^2 like for the contacts, the resulting accelerations are added to the gravity during integration
+struct LongRangeForces
+{
+	struct Attractor
+	{
+		Vec2 position;
+		// acceleration scale, negative for a repulsor
+		float strength;
+	};
+
+	struct Node
+	{
+		float center_x;
+		float center_y;
+		float mass;
+		// side of the node square
+		float size;
+		// children are contiguous, a leaf has no child and owns the sorted objects in [begin, end)
+		uint32_t first_child;
+		uint32_t child_count;
+		uint32_t begin;
+		uint32_t end;
+	};
+
+	// morton codes use 16 bits per axis
+	static constexpr uint32_t max_depth = 16;
+	static constexpr uint32_t leaf_size = 8;
+	// nodes of this depth are the roots of the subtrees built in parallel, up to 4^parallel_depth tasks
+	static constexpr uint32_t parallel_depth = 3;
+
+	// mutual attraction scale, 0 disables the tree
+	float attraction = 0.0f;
+	// a node is approximated by its center of mass when its size is below opening_angle times its softened distance
+	// 0 gives the exact O(N^2) sum, larger values are faster and less accurate
+	float opening_angle = 0.5f;
+	// avoids the singularity of close objects, forces are computed as if distances were at least this length
+	float softening = 1.0f;
+	std::vector<Attractor> attractors;
+
+	// per object accelerations, indexed like the objects data
+	AlignedVector<float> acceleration_x;
+	AlignedVector<float> acceleration_y;
+	// the same accelerations indexed by object id, with the operation id of the object they were computed for
+	std::vector<float> id_acceleration_x;
+	std::vector<float> id_acceleration_y;
+	std::vector<civ::ID> id_validity;
+
+	std::vector<Node> nodes;
+	// objects sorted along the morton curve, their codes, data indices and copies of their positions and masses
+	std::vector<uint32_t> sorted_codes;
+	std::vector<uint32_t> sorted_indices;
+	RadixSort sorter;
+	std::vector<float> sorted_x;
+	std::vector<float> sorted_y;
+	std::vector<float> sorted_mass;
+	// nodes at parallel_depth and the subtrees built from them
+	std::vector<uint32_t> subtree_roots;
+	std::vector<std::vector<Node>> subtrees;
+	std::vector<uint32_t> subtree_offsets;
+
+	[[nodiscard]]
+	bool isActive() const
+	{
+		return attraction != 0.0f || !attractors.empty();
+	}
+
+	void addAttractor(Vec2 position, float strength)
+	{
+		attractors.push_back({ position, strength });
+	}
+
+	// the tree covers the [0, world_extent]^2 square, objects outside of it are clamped to its borders
+	void update(const ParticleStore& objects, float world_extent, tp::ThreadPool& thread_pool)
+	{
+		const uint32_t objects_count = to<uint32_t>(objects.size());
+		acceleration_x.resize(objects_count);
+		acceleration_y.resize(objects_count);
+		if (attraction != 0.0f)
+		{
+			sortObjects(objects, world_extent, thread_pool);
+			buildTree(world_extent, thread_pool);
+		}
+		thread_pool.dispatch(objects_count, [&](uint32_t start, uint32_t end) {
+			for (uint32_t i{start}; i < end; ++i)
+			{
+				// walks the objects in curve order so that neighbors visit the same nodes
+				const uint32_t index = attraction != 0.0f ? sorted_indices[i] : i;
+				const Vec2 position = attraction != 0.0f ? Vec2{ sorted_x[i], sorted_y[i] } : objects.getPosition(index);
+				Vec2 acceleration = getAttractorsAcceleration(position);
+				if (attraction != 0.0f)
+				{
+					acceleration += getMutualAcceleration(position, i) * attraction;
+				}
+				acceleration_x[index] = acceleration.x;
+				acceleration_y[index] = acceleration.y;
+			}
+		});
+		const auto slots_count = to<uint32_t>(objects.ids.size());
+		id_acceleration_x.resize(slots_count);
+		id_acceleration_y.resize(slots_count);
+		id_validity.resize(slots_count);
+		thread_pool.dispatch(objects_count, [&](uint32_t start, uint32_t end) {
+			for (uint32_t i{start}; i < end; ++i)
+			{
+				const civ::ID id = objects.getID(i);
+				id_acceleration_x[id] = acceleration_x[i];
+				id_acceleration_y[id] = acceleration_y[i];
+				id_validity[id] = objects.getValidityID(id);
+			}
+		});
+	}
+
+	// moves the accelerations of the last update to the new data indices of their objects after objects were added
+	// or removed, objects created since then get no acceleration until the next update
+	void followObjects(const ParticleStore& objects, tp::ThreadPool& thread_pool)
+	{
+		const uint32_t objects_count = to<uint32_t>(objects.size());
+		acceleration_x.resize(objects_count);
+		acceleration_y.resize(objects_count);
+		thread_pool.dispatch(objects_count, [&](uint32_t start, uint32_t end) {
+			for (uint32_t i{start}; i < end; ++i)
+			{
+				const civ::ID id = objects.getID(i);
+				const bool known = id < id_validity.size() && id_validity[id] == objects.getValidityID(id);
+				acceleration_x[i] = known ? id_acceleration_x[id] : 0.0f;
+				acceleration_y[i] = known ? id_acceleration_y[id] : 0.0f;
+			}
+		});
+	}
+
+private:
+	[[nodiscard]]
+	Vec2 getAttractorsAcceleration(Vec2 position) const
+	{
+		const float softening2 = softening * softening;
+		Vec2 acceleration = { 0.0f, 0.0f };
+		for (const Attractor& attractor : attractors)
+		{
+			const Vec2 delta = attractor.position - position;
+			acceleration += delta * (attractor.strength * getInverseDistance3(delta.x * delta.x + delta.y * delta.y + softening2));
+		}
+		return acceleration;
+	}
+
+	[[nodiscard]]
+	static float getInverseDistance3(float distance2)
+	{
+		const float inverse_distance = 1.0f / std::sqrt(distance2);
+		return inverse_distance * inverse_distance * inverse_distance;
+	}
+
+	// acceleration given by all the other objects, for a unit attraction
+	[[nodiscard]]
+	Vec2 getMutualAcceleration(Vec2 position, uint32_t self) const
+	{
+		const float opening2 = opening_angle * opening_angle;
+		const float softening2 = softening * softening;
+		float acceleration_x_sum = 0.0f;
+		float acceleration_y_sum = 0.0f;
+		std::array<uint32_t, 4 * max_depth + 1> stack;
+		uint32_t stack_size = 0;
+		stack[stack_size++] = 0;
+		while (stack_size)
+		{
+			const Node& node = nodes[stack[--stack_size]];
+			const float dx = node.center_x - position.x;
+			const float dy = node.center_y - position.y;
+			const float distance2 = dx * dx + dy * dy;
+			// forces are smooth below the softening length, dense clusters are approximated too
+			// a node holding the object itself is always opened so that it does not attract itself
+			const bool holds_self = self >= node.begin && self < node.end;
+			if (!holds_self && node.size * node.size < opening2 * (distance2 + softening2))
+			{
+				const float scale = node.mass * getInverseDistance3(distance2 + softening2);
+				acceleration_x_sum += dx * scale;
+				acceleration_y_sum += dy * scale;
+			}
+			else if (node.child_count)
+			{
+				for (uint32_t c{0}; c < node.child_count; ++c)
+				{
+					stack[stack_size++] = node.first_child + c;
+				}
+			}
+			else
+			{
+				for (uint32_t j{node.begin}; j < node.end; ++j)
+				{
+					if (j == self)
+					{
+						continue;
+					}
+					const float object_dx = sorted_x[j] - position.x;
+					const float object_dy = sorted_y[j] - position.y;
+					const float scale = sorted_mass[j] * getInverseDistance3(object_dx * object_dx + object_dy * object_dy + softening2);
+					acceleration_x_sum += object_dx * scale;
+					acceleration_y_sum += object_dy * scale;
+				}
+			}
+		}
+		return { acceleration_x_sum, acceleration_y_sum };
+	}
+
+	[[nodiscard]]
+	static uint32_t spreadBits(uint32_t v)
+	{
+		v = (v | (v << 8)) & 0x00FF00FFu;
+		v = (v | (v << 4)) & 0x0F0F0F0Fu;
+		v = (v | (v << 2)) & 0x33333333u;
+		v = (v | (v << 1)) & 0x55555555u;
+		return v;
+	}
+
+	// data indices sorted by morton code with a parallel radix sort
+	void sortObjects(const ParticleStore& objects, float world_extent, tp::ThreadPool& thread_pool)
+	{
+		const uint32_t objects_count = to<uint32_t>(objects.size());
+		const float max_coordinate = to<float>((1u << max_depth) - 1u);
+		const float scale = max_coordinate / world_extent;
+		sorted_codes.resize(objects_count);
+		sorted_indices.resize(objects_count);
+		thread_pool.dispatch(objects_count, [&](uint32_t start, uint32_t end) {
+			for (uint32_t i{start}; i < end; ++i)
+			{
+				const auto x = to<uint32_t>(std::clamp(objects.position_x[i] * scale, 0.0f, max_coordinate));
+				const auto y = to<uint32_t>(std::clamp(objects.position_y[i] * scale, 0.0f, max_coordinate));
+				sorted_codes[i] = spreadBits(x) | (spreadBits(y) << 1);
+				sorted_indices[i] = i;
+			}
+		});
+		sorter.sort(sorted_codes, sorted_indices, 0xFFFFFFFF, thread_pool);
+		sorted_x.resize(objects_count);
+		sorted_y.resize(objects_count);
+		sorted_mass.resize(objects_count);
+		thread_pool.dispatch(objects_count, [&](uint32_t start, uint32_t end) {
+			for (uint32_t i{start}; i < end; ++i)
+			{
+				const uint32_t index = sorted_indices[i];
+				sorted_x[i] = objects.position_x[index];
+				sorted_y[i] = objects.position_y[index];
+				sorted_mass[i] = objects.radius[index] * objects.radius[index];
+			}
+		});
+	}
+
+	void buildTree(float world_extent, tp::ThreadPool& thread_pool)
+	{
+		nodes.clear();
+		subtree_roots.clear();
+		nodes.push_back({ 0.0f, 0.0f, 0.0f, world_extent, 0, 0, 0, to<uint32_t>(sorted_codes.size()) });
+		buildNode(nodes, 0, 0, true);
+		// subtrees are built in their own nodes list, their root replaces the pending node
+		subtrees.resize(subtree_roots.size());
+		thread_pool.dispatch(to<uint32_t>(subtree_roots.size()), [&](uint32_t start, uint32_t end) {
+			for (uint32_t s{start}; s < end; ++s)
+			{
+				std::vector<Node>& subtree = subtrees[s];
+				subtree.clear();
+				subtree.push_back(nodes[subtree_roots[s]]);
+				buildNode(subtree, 0, parallel_depth, false);
+			}
+		});
+		// the other subtree nodes are appended to the tree, children indices shifted accordingly
+		subtree_offsets.resize(subtree_roots.size());
+		auto offset = to<uint32_t>(nodes.size());
+		for (uint32_t s{0}; s < subtree_roots.size(); ++s)
+		{
+			subtree_offsets[s] = offset;
+			offset += to<uint32_t>(subtrees[s].size()) - 1;
+		}
+		nodes.resize(offset);
+		thread_pool.dispatch(to<uint32_t>(subtree_roots.size()), [&](uint32_t start, uint32_t end) {
+			for (uint32_t s{start}; s < end; ++s)
+			{
+				const std::vector<Node>& subtree = subtrees[s];
+				const uint32_t shift = subtree_offsets[s] - 1;
+				for (uint32_t i{0}; i < subtree.size(); ++i)
+				{
+					Node node = subtree[i];
+					node.first_child += node.child_count ? shift : 0;
+					nodes[i ? shift + i : subtree_roots[s]] = node;
+				}
+			}
+		});
+		// the top levels masses depend on the subtrees, children always come after their parent
+		for (uint32_t i{to<uint32_t>(nodes.size())}; i--;)
+		{
+			if (nodes[i].child_count && !isInSubtree(i))
+			{
+				updateMass(nodes, i);
+			}
+		}
+	}
+
+	// nodes created by the serial part are the ones before the first subtree node
+	[[nodiscard]]
+	bool isInSubtree(uint32_t i) const
+	{
+		return !subtree_offsets.empty() && i >= subtree_offsets[0];
+	}
+
+	// splits the node in up to 4 children by the next 2 bits of the morton codes
+	// the serial pass stops at parallel_depth and records the node as a subtree root instead
+	void buildNode(std::vector<Node>& list, uint32_t node_index, uint32_t depth, bool serial)
+	{
+		const uint32_t begin = list[node_index].begin;
+		const uint32_t end = list[node_index].end;
+		if (end - begin <= leaf_size || depth == max_depth)
+		{
+			list[node_index].child_count = 0;
+			updateMass(list, node_index);
+			return;
+		}
+		if (serial && depth == parallel_depth)
+		{
+			subtree_roots.push_back(node_index);
+			return;
+		}
+		const uint32_t shift = 2 * (max_depth - 1 - depth);
+		const float child_size = list[node_index].size * 0.5f;
+		const auto first_child = to<uint32_t>(list.size());
+		uint32_t child_begin = begin;
+		for (uint32_t quadrant{0}; quadrant < 4 && child_begin < end; ++quadrant)
+		{
+			const auto child_end = to<uint32_t>(std::partition_point(sorted_codes.begin() + child_begin, sorted_codes.begin() + end, [&](uint32_t code) {
+				return ((code >> shift) & 3) <= quadrant;
+			}) - sorted_codes.begin());
+			if (child_end > child_begin)
+			{
+				list.push_back({ 0.0f, 0.0f, 0.0f, child_size, 0, 0, child_begin, child_end });
+			}
+			child_begin = child_end;
+		}
+		const uint32_t child_count = to<uint32_t>(list.size()) - first_child;
+		list[node_index].first_child = first_child;
+		list[node_index].child_count = child_count;
+		for (uint32_t c{0}; c < child_count; ++c)
+		{
+			buildNode(list, first_child + c, depth + 1, serial);
+		}
+		updateMass(list, node_index);
+	}
+
+	void updateMass(std::vector<Node>& list, uint32_t node_index) const
+	{
+		Node& node = list[node_index];
+		float mass = 0.0f;
+		float weighted_x = 0.0f;
+		float weighted_y = 0.0f;
+		if (node.child_count)
+		{
+			for (uint32_t c{node.first_child}; c < node.first_child + node.child_count; ++c)
+			{
+				mass += list[c].mass;
+				weighted_x += list[c].center_x * list[c].mass;
+				weighted_y += list[c].center_y * list[c].mass;
+			}
+		}
+		else
+		{
+			for (uint32_t i{node.begin}; i < node.end; ++i)
+			{
+				mass += sorted_mass[i];
+				weighted_x += sorted_x[i] * sorted_mass[i];
+				weighted_y += sorted_y[i] * sorted_mass[i];
+			}
+		}
+		node.mass = mass;
+		node.center_x = mass > 0.0f ? weighted_x / mass : 0.0f;
+		node.center_y = mass > 0.0f ? weighted_y / mass : 0.0f;
+	}
+};
+#endif // !LONGRANGEFORCES_H
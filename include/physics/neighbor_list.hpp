@@ -0,0 +1,113 @@
+#ifndef NEIGHBORLIST_H
+#define NEIGHBORLIST_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "verlet_lists.hpp"
+#include "collision_grid.hpp"
+#include "collision_tiles.hpp"
+#include "engine/common/utils.hpp"
+#include "thread_pool/thread_pool.hpp"
+
+// verlet lists of the unit grid atoms found in the grid cells, slots are the grid atoms order so the grid
+// must not be rebuilt in between builds
+// a pair is stored by the atom of the lowest cell, and its other atom is at most two columns after it and
+// two rows away from it, so the candidates are all in the 5x5 cells around an atom as long as the skin is at most 1
+// and the pairs are solved by tiles of at least min_tile_size cells
+struct NeighborList : public VerletLists
+{
+	static constexpr int32_t min_tile_size = 4;
+	// the lists are found from the unit grid, which has to be rebuilt with them
+	static constexpr bool uses_grid = true;
+
+	CollisionTiles tiles;
+
+	template<typename TGrid>
+	void build(const ParticleStore& objects, const TGrid& grid, tp::ThreadPool& thread_pool)
+	{
+		buildLists(objects, to<uint32_t>(grid.atoms.size()), thread_pool, [&](uint32_t slot, auto&& callback) {
+			forEachCandidate(objects, grid, slot, callback);
+		});
+	}
+
+	// pairs solved by tile colors, the pairs of a column also move the two next ones
+	// so a column is solved if any of them is awake
+	template<typename TGrid, typename TCallback>
+	void forEachPair(const ParticleStore& objects, const TGrid& grid, float sleep_steps, int32_t tile_size, tp::ThreadPool& thread_pool, TCallback&& solve_pair)
+	{
+		tiles.update(grid, tile_size, thread_pool.thread_count_, min_tile_size);
+		tiles.updateColumnAwake(grid, objects, sleep_steps, thread_pool);
+		const auto awake_end = tiles.column_awake.end();
+		for (uint32_t pass{0}; pass < iterations; ++pass)
+		{
+			tiles.forEachTileByColor(thread_pool, [&](uint32_t tile, uint32_t) {
+				const IVec2 origin = tiles.getOrigin(tile);
+				grid.forEachColumn(origin.x, origin.x + tiles.tile_size, [&](const GridColumn& column) {
+					const auto awake_begin = tiles.column_awake.begin() + column.x;
+					if (std::none_of(awake_begin, std::min(awake_begin + 3, awake_end), [](uint8_t awake) { return awake; }))
+					{
+						return;
+					}
+					const uint32_t slot_begin = getSlot(grid, column, origin.y);
+					const uint32_t slot_end = getSlot(grid, column, origin.y + tiles.tile_size);
+					forEachSlotPair(grid.atoms.data(), slot_begin, slot_end, solve_pair);
+				});
+			});
+		}
+	}
+
+private:
+	// first slot of the column atoms whose row is at least row, atoms are sorted by cell
+	template<typename TGrid>
+	[[nodiscard]]
+	static uint32_t getSlot(const TGrid& grid, const GridColumn& column, int32_t row)
+	{
+		const auto cell = to<uint32_t>(column.x * grid.height + std::clamp(row, 0, grid.height));
+		const auto first = grid.atoms.begin() + column.atoms_begin;
+		const auto last = grid.atoms.begin() + column.atoms_end;
+		return to<uint32_t>(std::lower_bound(first, last, cell, [&grid](uint32_t atom, uint32_t c) {
+			return grid.atom_cell[atom] < c;
+		}) - grid.atoms.begin());
+	}
+
+	// the atoms after this one in its cell, then the ones of the two cells below
+	// and of the 5 rows around it in the two next columns
+	template<typename TGrid, typename TCallback>
+	void forEachCandidate(const ParticleStore& objects, const TGrid& grid, uint32_t slot, TCallback&& callback) const
+	{
+		const uint32_t atom = grid.atoms[slot];
+		const uint32_t cell = grid.atom_cell[atom];
+		const auto x = to<int32_t>(cell / to<uint32_t>(grid.height));
+		const auto y = to<int32_t>(cell % to<uint32_t>(grid.height));
+		const auto test = [&](uint32_t other) {
+			if (isCandidate(objects, atom, other))
+			{
+				callback(other);
+			}
+		};
+		for (uint32_t k{slot + 1}; k < grid.atoms.size() && grid.atom_cell[grid.atoms[k]] == cell; ++k)
+		{
+			test(grid.atoms[k]);
+		}
+		const auto test_cell = [&](int32_t cell_x, int32_t cell_y) {
+			const CollisionCell other_cell = grid.getCell(cell_x, cell_y);
+			for (uint32_t i{0}; i < other_cell.objects_count; ++i)
+			{
+				test(other_cell.objects[i]);
+			}
+		};
+		for (int32_t cell_y{y + 1}; cell_y <= std::min(y + 2, grid.height - 1); ++cell_y)
+		{
+			test_cell(x, cell_y);
+		}
+		for (int32_t cell_x{x + 1}; cell_x <= std::min(x + 2, grid.width - 1); ++cell_x)
+		{
+			for (int32_t cell_y{std::max(y - 2, 0)}; cell_y <= std::min(y + 2, grid.height - 1); ++cell_y)
+			{
+				test_cell(cell_x, cell_y);
+			}
+		}
+	}
+};
+#endif // !NEIGHBORLIST_H
@@ -0,0 +1,751 @@
+#ifndef PARTICLESTORE_H
+#define PARTICLESTORE_H
+
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include "simd.hpp"
+#include "physic_object.hpp"
+#include "engine/common/index_vector.hpp"
+#include "engine/common/aligned_allocator.hpp"
+#include "thread_pool/thread_pool.hpp"
+
+struct ParticleStore;
+
+#ifdef POLYMAT_COMPACT_STATE
+// civ::SlotMetadata on 32 bits, stores are limited to 2^32 objects and operation ids wrap around,
+// so a reference or link kept across 2^32 creations and erasures can be taken as valid again
+using StoredID = uint32_t;
+
+struct ParticleSlot
+{
+	uint32_t rid;
+	uint32_t op_id;
+};
+
+// colors are indices in a fixed 3-3-2 bits RGB palette
+using StoredColor = uint8_t;
+
+[[nodiscard]]
+inline StoredColor packColor(Color c)
+{
+	return to<uint8_t>((c.r & 0xE0) | ((c.g >> 3) & 0x1C) | (c.b >> 6));
+}
+
+[[nodiscard]]
+inline Color unpackColor(StoredColor c)
+{
+	// spreads the palette over the full channels range
+	const auto r = to<uint8_t>(((c >> 5) & 0x7) * 255 / 7);
+	const auto g = to<uint8_t>(((c >> 2) & 0x7) * 255 / 7);
+	const auto b = to<uint8_t>((c & 0x3) * 255 / 3);
+	return { r, g, b };
+}
+#else
+using StoredID = civ::ID;
+using ParticleSlot = civ::SlotMetadata;
+
+using StoredColor = Color;
+
+[[nodiscard]]
+inline StoredColor packColor(Color c)
+{
+	return c;
+}
+
+[[nodiscard]]
+inline Color unpackColor(StoredColor c)
+{
+	return c;
+}
+#endif
+
+// objects created by one batch, they are contiguous in data order until the next erase or reorder
+// their ids are getID(first) to getID(first + count - 1), only consecutive if no erased slot was reused
+struct ObjectBatch
+{
+	uint64_t first;
+	uint64_t count;
+};
+
+// lightweight accessor mimicking PhysicObject on top of the SoA storage
+// it is bound to a data index, so it is invalidated by any erase
+// moving the object through it wakes it up
+struct PhysicObjectRef
+{
+	ParticleStore& store;
+	uint64_t index;
+
+	PhysicObjectRef(ParticleStore& store_, uint64_t index_)
+		: store{ store_ }, index{ index_ }
+	{ }
+
+	[[nodiscard]]
+	Vec2 getPosition() const;
+	[[nodiscard]]
+	Vec2 getLastPosition() const;
+	[[nodiscard]]
+	Color getColor() const;
+	[[nodiscard]]
+	float getRadius() const;
+	[[nodiscard]]
+	float getSpeed() const;
+	[[nodiscard]]
+	Vec2 getVelocity() const;
+	[[nodiscard]]
+	PhysicObject load() const;
+
+	void setPosition(Vec2 pos);
+	void setPositionSameSpeed(Vec2 new_position);
+	void setColor(Color c);
+	void addVelocity(Vec2 v);
+	void move(Vec2 v);
+	void stop();
+	void slowdown(float ratio);
+	void wake();
+};
+
+// structure of arrays particle storage
+// ids follow the civ::Vector semantic: an id stays valid until the object is erased
+// while its data index may change (swap pop on erase)
+// accelerations are not stored, the solver only applies gravity and a pushed object pending acceleration is dropped
+// the compact state stores the verlet velocity, position - last_position, as half floats instead of the last position,
+// solvers move objects through displace() so that their velocity follows as if the last position was kept
+struct ParticleStore
+{
+	AlignedVector<float> position_x;
+	AlignedVector<float> position_y;
+#ifdef POLYMAT_COMPACT_STATE
+	AlignedVector<uint16_t> velocity_x;
+	AlignedVector<uint16_t> velocity_y;
+#else
+	AlignedVector<float> last_position_x;
+	AlignedVector<float> last_position_y;
+#endif
+	AlignedVector<StoredColor> color;
+	AlignedVector<float> radius;
+	// consecutive substeps spent below the solver sleep speed, sleeping once above its sleep steps
+	// the counters saturate at max_rest_steps
+#ifdef POLYMAT_COMPACT_STATE
+	static constexpr float max_rest_steps = 255.0f;
+	AlignedVector<uint8_t> rest_steps;
+#else
+	static constexpr float max_rest_steps = std::numeric_limits<float>::max();
+	AlignedVector<float> rest_steps;
+#endif
+
+	// batches below this size are created by the calling thread
+	static constexpr uint64_t parallel_batch_size = 4096;
+
+	// civ bookkeeping
+	std::vector<StoredID> ids;
+	std::vector<ParticleSlot> metadata;
+	uint64_t data_size = 0;
+	uint64_t op_count = 0;
+	// reused by every float array permutation
+	AlignedVector<float> reorder_scratch;
+	// parallel remove_if buffers
+	static constexpr uint64_t remove_chunk_size = 4096;
+	std::vector<uint8_t> remove_flags;
+	std::vector<uint32_t> remove_holes;
+	std::vector<uint32_t> remove_movers;
+
+	ParticleStore() = default;
+
+	civ::ID emplace_back(Vec2 position, float object_radius = PhysicObject::default_radius)
+	{
+		const civ::Slot slot = getSlot();
+		storeAt(slot.data_id, PhysicObject{ position, object_radius });
+		return slot.id;
+	}
+
+	civ::ID push_back(const PhysicObject& object)
+	{
+		const civ::Slot slot = getSlot();
+		storeAt(slot.data_id, object);
+		return slot.id;
+	}
+
+	// creates count objects with a single regrowth of the arrays, slots are filled in parallel for large batches
+	ObjectBatch emplace_back(const Vec2* positions, uint64_t count, float object_radius, tp::ThreadPool& thread_pool)
+	{
+		const uint64_t first = data_size;
+		const uint64_t new_size = data_size + count;
+		// reuse the free slots first then create the missing ones, ids of new slots are their data index
+		if (new_size > metadata.size())
+		{
+			resizeSlots(new_size);
+		}
+		const uint64_t first_op = op_count;
+		op_count += count;
+		const auto fill = [&](uint32_t start, uint32_t end) {
+			for (uint64_t i{start}; i < end; ++i)
+			{
+				metadata[first + i].op_id = to<StoredID>(first_op + i);
+				storeAt(first + i, PhysicObject{ positions[i], object_radius });
+			}
+		};
+		if (count < parallel_batch_size)
+		{
+			fill(0, to<uint32_t>(count));
+		}
+		else
+		{
+			thread_pool.dispatch(to<uint32_t>(count), fill);
+		}
+		data_size = new_size;
+		return { first, count };
+	}
+
+	void erase(civ::ID id)
+	{
+		const uint64_t data_index = ids[id];
+		// check if the object has been already erased
+		if (data_index >= data_size) return;
+		// swap the object at the end
+		--data_size;
+		const StoredID last_id = metadata[data_size].rid;
+		swapData(data_size, data_index);
+		std::swap(metadata[data_size], metadata[data_index]);
+		std::swap(ids[last_id], ids[id]);
+		// invalidate the operation
+		metadata[data_size].op_id = to<StoredID>(++op_count);
+	}
+
+	// already erased ids are skipped
+	void erase(const civ::ID* erased_ids, uint64_t count)
+	{
+		for (uint64_t i{0}; i < count; ++i)
+		{
+			erase(erased_ids[i]);
+		}
+	}
+
+	template<typename TPredicate>
+	void remove_if(TPredicate&& f)
+	{
+		for (uint64_t data_index{ 0 }; data_index < data_size;)
+		{
+			if (f(PhysicObjectRef{ *this, data_index }))
+			{
+				erase(metadata[data_index].rid);
+			}
+			else
+			{
+				data_index++;
+			}
+		}
+	}
+
+	// parallel version, removed objects end up past the kept ones as with erase
+	template<typename TPredicate>
+	void remove_if(TPredicate&& f, tp::ThreadPool& thread_pool)
+	{
+		const uint32_t count = to<uint32_t>(data_size);
+		remove_flags.resize(count);
+		thread_pool.dispatch(count, [&](uint32_t start, uint32_t end) {
+			for (uint32_t i{start}; i < end; ++i)
+			{
+				remove_flags[i] = f(PhysicObjectRef{ *this, i });
+			}
+		});
+		const uint64_t kept_count = civ::computeRemoveSwaps(remove_flags, count, remove_chunk_size, remove_holes, remove_movers, thread_pool);
+		thread_pool.dispatch(to<uint32_t>(remove_holes.size()), [&](uint32_t start, uint32_t end) {
+			for (uint32_t i{start}; i < end; ++i)
+			{
+				const uint32_t hole = remove_holes[i];
+				const uint32_t mover = remove_movers[i];
+				swapData(hole, mover);
+				std::swap(metadata[hole], metadata[mover]);
+				ids[metadata[hole].rid] = hole;
+				ids[metadata[mover].rid] = mover;
+			}
+		});
+		for (uint64_t i{kept_count}; i < count; ++i)
+		{
+			// invalidate the operation
+			metadata[i].op_id = to<StoredID>(++op_count);
+		}
+		data_size = kept_count;
+	}
+
+	// moves the object at data index order[i] to index i, ids stay valid
+	// order has to be a permutation of [0, size())
+	void reorder(const std::vector<uint32_t>& order, tp::ThreadPool& thread_pool)
+	{
+		forEachArray([&](auto& v) {
+			permute(v, order, thread_pool);
+		});
+		std::vector<ParticleSlot> metadata_scratch;
+		permute(metadata, order, metadata_scratch, thread_pool);
+		thread_pool.dispatch(to<uint32_t>(data_size), [&](uint32_t start, uint32_t end) {
+			for (uint32_t i{start}; i < end; ++i)
+			{
+				ids[metadata[i].rid] = i;
+			}
+		});
+	}
+
+	void reserve(uint64_t capacity)
+	{
+		forEachArray([capacity](auto& v) {
+			v.reserve(capacity);
+		});
+		ids.reserve(capacity);
+		metadata.reserve(capacity);
+	}
+
+	void clear()
+	{
+		forEachArray([](auto& v) {
+			v.clear();
+		});
+		ids.clear();
+		metadata.clear();
+		data_size = 0;
+	}
+
+	PhysicObjectRef operator[](civ::ID id)
+	{
+		return { *this, ids[id] };
+	}
+
+	PhysicObjectRef getDataAt(uint64_t i)
+	{
+		return { *this, i };
+	}
+
+	[[nodiscard]]
+	Vec2 getPosition(uint64_t i) const
+	{
+		return { position_x[i], position_y[i] };
+	}
+
+	[[nodiscard]]
+	Vec2 getLastPosition(uint64_t i) const
+	{
+#ifdef POLYMAT_COMPACT_STATE
+		return getPosition(i) - getVelocity(i);
+#else
+		return { last_position_x[i], last_position_y[i] };
+#endif
+	}
+
+	// move since the last integration
+	[[nodiscard]]
+	Vec2 getVelocity(uint64_t i) const
+	{
+#ifdef POLYMAT_COMPACT_STATE
+		return { simd::fromHalf(velocity_x[i]), simd::fromHalf(velocity_y[i]) };
+#else
+		return { position_x[i] - last_position_x[i], position_y[i] - last_position_y[i] };
+#endif
+	}
+
+	void setLastPosition(uint64_t i, Vec2 last_position)
+	{
+#ifdef POLYMAT_COMPACT_STATE
+		setVelocity(i, getPosition(i) - last_position);
+#else
+		last_position_x[i] = last_position.x;
+		last_position_y[i] = last_position.y;
+#endif
+	}
+
+	void setVelocity(uint64_t i, Vec2 velocity)
+	{
+#ifdef POLYMAT_COMPACT_STATE
+		velocity_x[i] = simd::toHalf(velocity.x);
+		velocity_y[i] = simd::toHalf(velocity.y);
+#else
+		last_position_x[i] = position_x[i] - velocity.x;
+		last_position_y[i] = position_y[i] - velocity.y;
+#endif
+	}
+
+	void addVelocity(uint64_t i, Vec2 velocity)
+	{
+#ifdef POLYMAT_COMPACT_STATE
+		setVelocity(i, getVelocity(i) + velocity);
+#else
+		last_position_x[i] -= velocity.x;
+		last_position_y[i] -= velocity.y;
+#endif
+	}
+
+	// moves an object while keeping its last position, as contacts and constraints do, so its velocity changes as much
+	void displace(uint64_t i, float dx, float dy)
+	{
+		position_x[i] += dx;
+		position_y[i] += dy;
+#ifdef POLYMAT_COMPACT_STATE
+		setVelocity(i, getVelocity(i) + Vec2{ dx, dy });
+#endif
+	}
+
+	void displaceTo(uint64_t i, float x, float y)
+	{
+#ifdef POLYMAT_COMPACT_STATE
+		setVelocity(i, getVelocity(i) + Vec2{ x - position_x[i], y - position_y[i] });
+#endif
+		position_x[i] = x;
+		position_y[i] = y;
+	}
+
+	// vectorized accessors of the objects [i, i + TFloat::width) for the integrator
+	template<typename TFloat>
+	[[nodiscard]]
+	TFloat loadVelocityX(uint64_t i) const
+	{
+#ifdef POLYMAT_COMPACT_STATE
+		return TFloat::loadHalf(velocity_x.data() + i);
+#else
+		return TFloat::load(position_x.data() + i) - TFloat::load(last_position_x.data() + i);
+#endif
+	}
+
+	template<typename TFloat>
+	[[nodiscard]]
+	TFloat loadVelocityY(uint64_t i) const
+	{
+#ifdef POLYMAT_COMPACT_STATE
+		return TFloat::loadHalf(velocity_y.data() + i);
+#else
+		return TFloat::load(position_y.data() + i) - TFloat::load(last_position_y.data() + i);
+#endif
+	}
+
+	template<typename TFloat>
+	[[nodiscard]]
+	TFloat loadRestSteps(uint64_t i) const
+	{
+#ifdef POLYMAT_COMPACT_STATE
+		return TFloat::loadBytes(rest_steps.data() + i);
+#else
+		return TFloat::load(rest_steps.data() + i);
+#endif
+	}
+
+	// rest has to be in [0, max_rest_steps]
+	template<typename TFloat>
+	void storeRestSteps(uint64_t i, TFloat rest)
+	{
+#ifdef POLYMAT_COMPACT_STATE
+		rest.storeBytes(rest_steps.data() + i);
+#else
+		rest.store(rest_steps.data() + i);
+#endif
+	}
+
+	// ends an integration step, the objects went from the last positions to the new ones
+	template<typename TFloat>
+	void storeStep(uint64_t i, TFloat last_x, TFloat last_y, TFloat new_x, TFloat new_y)
+	{
+#ifdef POLYMAT_COMPACT_STATE
+		(new_x - last_x).storeHalf(velocity_x.data() + i);
+		(new_y - last_y).storeHalf(velocity_y.data() + i);
+#else
+		last_x.store(last_position_x.data() + i);
+		last_y.store(last_position_y.data() + i);
+#endif
+		new_x.store(position_x.data() + i);
+		new_y.store(position_y.data() + i);
+	}
+
+	// ends an integration step where the objects did not move from x, y
+	template<typename TFloat>
+	void storeRest(uint64_t i, [[maybe_unused]] TFloat x, [[maybe_unused]] TFloat y)
+	{
+#ifdef POLYMAT_COMPACT_STATE
+		TFloat::broadcast(0.0f).storeHalf(velocity_x.data() + i);
+		TFloat::broadcast(0.0f).storeHalf(velocity_y.data() + i);
+#else
+		x.store(last_position_x.data() + i);
+		y.store(last_position_y.data() + i);
+#endif
+	}
+
+	[[nodiscard]]
+	bool isAwake(uint64_t i, float sleep_steps) const
+	{
+		return rest_steps[i] < sleep_steps;
+	}
+
+	[[nodiscard]]
+	PhysicObject loadAt(uint64_t i) const
+	{
+		PhysicObject object;
+		object.position = getPosition(i);
+		object.last_position = getLastPosition(i);
+		object.color = unpackColor(color[i]);
+		object.radius = radius[i];
+		return object;
+	}
+
+	void storeAt(uint64_t i, const PhysicObject& object)
+	{
+		position_x[i] = object.position.x;
+		position_y[i] = object.position.y;
+		setLastPosition(i, object.last_position);
+		color[i] = packColor(object.color);
+		radius[i] = object.radius;
+		rest_steps[i] = 0;
+	}
+
+	// FNV-1a hash of the objects state in data order, bit identical states give equal checksums
+	[[nodiscard]]
+	uint64_t getChecksum() const
+	{
+		uint64_t hash = 14695981039346656037ull;
+		const auto add = [&hash](uint32_t bits) {
+			for (uint32_t byte{0}; byte < 4; ++byte)
+			{
+				hash ^= (bits >> (8 * byte)) & 0xFF;
+				hash *= 1099511628211ull;
+			}
+		};
+		const auto add_float = [&add](float value) {
+			uint32_t bits;
+			std::memcpy(&bits, &value, sizeof(bits));
+			add(bits);
+		};
+		for (uint64_t i{0}; i < data_size; ++i)
+		{
+			add(to<uint32_t>(metadata[i].rid));
+			add_float(position_x[i]);
+			add_float(position_y[i]);
+#ifdef POLYMAT_COMPACT_STATE
+			add(velocity_x[i]);
+			add(velocity_y[i]);
+#else
+			add_float(last_position_x[i]);
+			add_float(last_position_y[i]);
+#endif
+		}
+		return hash;
+	}
+
+	[[nodiscard]]
+	uint64_t size() const
+	{
+		return data_size;
+	}
+
+	[[nodiscard]]
+	civ::ID getID(uint64_t i) const
+	{
+		return metadata[i].rid;
+	}
+
+	[[nodiscard]]
+	uint64_t getDataID(civ::ID id) const
+	{
+		return ids[id];
+	}
+
+	[[nodiscard]]
+	bool isValid(civ::ID id, civ::ID validity) const
+	{
+		return validity == metadata[ids[id]].op_id;
+	}
+
+	[[nodiscard]]
+	civ::ID getValidityID(civ::ID id) const
+	{
+		return metadata[ids[id]].op_id;
+	}
+
+	[[nodiscard]]
+	civ::ID getNextId() const
+	{
+		return isFull() ? data_size : metadata[data_size].rid;
+	}
+
+private:
+	[[nodiscard]]
+	bool isFull() const
+	{
+		return data_size == metadata.size();
+	}
+
+	civ::Slot createNewSlot()
+	{
+		forEachArray([](auto& v) {
+			v.emplace_back();
+		});
+		ids.push_back(to<StoredID>(data_size));
+		metadata.push_back({ to<StoredID>(data_size), to<StoredID>(op_count++) });
+		return { data_size, data_size };
+	}
+
+	void resizeSlots(uint64_t new_size)
+	{
+		forEachArray([new_size](auto& v) {
+			v.resize(new_size);
+		});
+		for (uint64_t i{metadata.size()}; i < new_size; ++i)
+		{
+			ids.push_back(to<StoredID>(i));
+			metadata.push_back({ to<StoredID>(i), 0 });
+		}
+	}
+
+	civ::Slot getFreeSlot()
+	{
+		const civ::ID reuse_id = metadata[data_size].rid;
+		metadata[data_size].op_id = to<StoredID>(op_count++);
+		return { reuse_id, data_size };
+	}
+
+	civ::Slot getSlot()
+	{
+		const civ::Slot slot = isFull() ? createNewSlot() : getFreeSlot();
+		++data_size;
+		return slot;
+	}
+
+	// calls callback(array) for each per object array
+	template<typename TCallback>
+	void forEachArray(TCallback&& callback)
+	{
+		callback(position_x);
+		callback(position_y);
+#ifdef POLYMAT_COMPACT_STATE
+		callback(velocity_x);
+		callback(velocity_y);
+#else
+		callback(last_position_x);
+		callback(last_position_y);
+#endif
+		callback(color);
+		callback(radius);
+		callback(rest_steps);
+	}
+
+	// float arrays share the reorder scratch
+	template<typename TVector>
+	void permute(TVector& v, const std::vector<uint32_t>& order, tp::ThreadPool& thread_pool)
+	{
+		if constexpr (std::is_same_v<TVector, AlignedVector<float>>)
+		{
+			permute(v, order, reorder_scratch, thread_pool);
+		}
+		else
+		{
+			TVector scratch;
+			permute(v, order, scratch, thread_pool);
+		}
+	}
+
+	// free slots past data_size keep their content
+	template<typename TVector>
+	void permute(TVector& v, const std::vector<uint32_t>& order, TVector& scratch, tp::ThreadPool& thread_pool)
+	{
+		scratch.resize(v.size());
+		thread_pool.dispatch(to<uint32_t>(data_size), [&](uint32_t start, uint32_t end) {
+			for (uint32_t i{start}; i < end; ++i)
+			{
+				scratch[i] = v[order[i]];
+			}
+		});
+		std::copy(v.begin() + data_size, v.end(), scratch.begin() + data_size);
+		std::swap(v, scratch);
+	}
+
+	void swapData(uint64_t a, uint64_t b)
+	{
+		forEachArray([a, b](auto& v) {
+			std::swap(v[a], v[b]);
+		});
+	}
+};
+
+inline Vec2 PhysicObjectRef::getPosition() const
+{
+	return store.getPosition(index);
+}
+
+inline Vec2 PhysicObjectRef::getLastPosition() const
+{
+	return store.getLastPosition(index);
+}
+
+inline Color PhysicObjectRef::getColor() const
+{
+	return unpackColor(store.color[index]);
+}
+
+inline float PhysicObjectRef::getRadius() const
+{
+	return store.radius[index];
+}
+
+inline float PhysicObjectRef::getSpeed() const
+{
+	return MathVec2::length(getVelocity());
+}
+
+inline Vec2 PhysicObjectRef::getVelocity() const
+{
+	return store.getVelocity(index);
+}
+
+inline PhysicObject PhysicObjectRef::load() const
+{
+	return store.loadAt(index);
+}
+
+inline void PhysicObjectRef::wake()
+{
+	store.rest_steps[index] = 0;
+}
+
+inline void PhysicObjectRef::setPosition(Vec2 pos)
+{
+	wake();
+	store.position_x[index] = pos.x;
+	store.position_y[index] = pos.y;
+	store.setVelocity(index, { 0.0f, 0.0f });
+}
+
+inline void PhysicObjectRef::setPositionSameSpeed(Vec2 new_position)
+{
+	wake();
+	const Vec2 velocity = getVelocity();
+	store.position_x[index] = new_position.x;
+	store.position_y[index] = new_position.y;
+	store.setVelocity(index, velocity);
+}
+
+inline void PhysicObjectRef::setColor(Color c)
+{
+	store.color[index] = packColor(c);
+}
+
+inline void PhysicObjectRef::addVelocity(Vec2 v)
+{
+	wake();
+	store.addVelocity(index, v);
+}
+
+inline void PhysicObjectRef::move(Vec2 v)
+{
+	wake();
+	store.displace(index, v.x, v.y);
+}
+
+inline void PhysicObjectRef::stop()
+{
+	wake();
+	store.setVelocity(index, { 0.0f, 0.0f });
+}
+
+inline void PhysicObjectRef::slowdown(float ratio)
+{
+	wake();
+	store.setLastPosition(index, getLastPosition() + ratio * getVelocity());
+}
+#endif // !PARTICLESTORE_H
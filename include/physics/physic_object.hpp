@@ -4,6 +4,7 @@
 #include "collision_grid.hpp"
 #include "engine/common/utils.hpp"
 #include "engine/common/math.hpp"
+#include "engine/common/color.hpp"
 
 struct PhysicObject
 {
@@ -11,7 +12,11 @@ struct PhysicObject
 	Vec2 position = { 0.0f, 0.0f };
 	Vec2 last_position = { 0.0f, 0.0f };
 	Vec2 acceleration = { 0.0f, 0.0f };
-	sf::Color color;
+	Color color;
+	// two default objects are in contact below a distance of 1.0f
+	float radius = default_radius;
+
+	static constexpr float default_radius = 0.5f;
 
 	PhysicObject() = default;
 
@@ -21,19 +26,31 @@ struct PhysicObject
 		last_position(position_)
 	{ }
 
+	PhysicObject(Vec2 position_, float radius_)
+		: position(position_),
+		last_position(position_),
+		radius(radius_)
+	{ }
+
 	void setPosition(Vec2 pos)
 	{
 		position = pos;
 		last_position = pos;
 	}
 
-	void update(float dt)
+	// arbitrary, approximating air friction
+	static constexpr float velocity_damping = 40.0f;
+
+	// returns the next verlet position, shared with the SoA solver pass
+	static Vec2 integrate(Vec2 position, Vec2 last_position, Vec2 acceleration, float dt)
 	{
 		const Vec2 last_update_move = position - last_position;
+		return position + last_update_move + (acceleration - last_update_move * velocity_damping) * (dt * dt);
+	}
 
-		const float VELOCITY_DAMPING = 40.0f; // arbitrary, approximating air friction
-
-		const Vec2 new_position = position + last_update_move + (acceleration - last_update_move * VELOCITY_DAMPING) * (dt * dt);
+	void update(float dt)
+	{
+		const Vec2 new_position = integrate(position, last_position, acceleration, dt);
 		last_position = position;
 		position = new_position;
 		acceleration = { 0.0f, 0.0f };
@@ -1,195 +1,853 @@
 #ifndef PHYSICS_H
 #define PHYSICS_H
 
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include "chunked_reduction.hpp"
 #include "collision_grid.hpp"
-#include "physic_object.hpp"
+#include "sparse_collision_grid.hpp"
+#include "particle_store.hpp"
+#include "verlet_integrator.hpp"
+#include "contact_solver.hpp"
+#include "contact_cache.hpp"
+#include "neighbor_list.hpp"
+#include "sweep_and_prune.hpp"
+#include "collision_tiles.hpp"
+#include "link_store.hpp"
+#include "distance_field.hpp"
+#include "long_range_forces.hpp"
 #include "engine/common/utils.hpp"
-#include "engine/common/index_vector.hpp"
 #include "thread_pool/thread_pool.hpp"
 
-struct PhysicSolver
+// TGrid bins the objects of each size class, CollisionGrid or SparseCollisionGrid
+// TBroadphase finds the unit size contacts in neighbor lists mode, see VerletLists for its interface:
+// NeighborList from the unit grid cells, or SweepAndPrune along one axis which does not use the unit grid
+// and so only supports the neighbor lists mode
+template<typename TGrid, typename TBroadphase = NeighborList>
+struct GenericPhysicSolver
 {
-	CIVector<PhysicObject> objects;
-	CollisionGrid grid;
+	static_assert(std::is_base_of_v<VerletLists, TBroadphase>, "TBroadphase has to provide the VerletLists interface");
+
+	ParticleStore objects;
+	// distance constraints between objects
+	LinkStore links;
+	// static obstacles, dense over the world but only allocated once a shape is added
+	DistanceField obstacles;
+	// mutual attraction and point attractors, computed once per frame
+	// sleeping objects ignore them until a contact wakes them up, sleeping should be disabled for moving attractors
+	LongRangeForces long_range_forces;
+	// unit cells grid holding the default size objects
+	TGrid grid;
+	// one grid per larger size class, cells of coarse_grids[i] are 2^(i + 1) units wide
+	std::vector<TGrid> coarse_grids;
+	IVec2 grid_size;
 	Vec2 world_size;
 	Vec2 gravity = { 0.0f, 20.0f };
 
 	// simulation solving pass count
 	uint32_t sub_steps;
+	// adaptive mode picks sub_steps each frame, in [min_sub_steps, max_sub_steps],
+	// so that the fastest object moves at most max_sub_step_displacement per substep, half a default object by default
+	bool adaptive_sub_steps = false;
+	uint32_t min_sub_steps = 2;
+	uint32_t max_sub_steps = 16;
+	float max_sub_step_displacement = 0.5f;
+	// substep duration the objects velocities are expressed for, 0 before the first update
+	float last_sub_dt = 0.0f;
+	// objects binned right after their integration, small enough for them to still be in cache, multiple of the SIMD width
+	static constexpr uint32_t bin_chunk_size = 1024;
+	ChunkedReduction reduction;
+	// frames between two spatial sorts of the objects, 0 to disable
+	uint32_t reorder_period = 60;
+	uint64_t frame_count = 0;
+	// objects moving slower than sleep_speed (units per second) during sleep_steps substeps are not integrated anymore
+	// and regions made only of sleeping objects are skipped by the collision pass, off by default since resting
+	// objects then freeze until a contact or a velocity change wakes them up
+	bool sleeping = false;
+	float sleep_speed = 1.5f;
+	// speed a contact has to give to a sleeping object to wake it up
+	float wake_speed = 5.0f;
+	// clamped to ParticleStore::max_rest_steps, 255 in the compact state
+	uint32_t sleep_steps = 60;
+	// results do not depend on the threads count: fixed tile size and reproducible cells order
+	bool deterministic = false;
+	static constexpr int32_t deterministic_tile_size = 16;
+	// collision tiles side in cells, 0 picks it from the occupied area and the threads count
+	uint32_t tile_size = 0;
+	CollisionTiles collision_tiles;
+	// jacobi mode: contacts are solved against the positions of the previous pass, every atom accumulates
+	// its own corrections that are applied afterwards, tiles are then independent and need no color barriers
+	// off by default, only measured on par with the colored passes on one core, the many-core gain is unverified
+	bool jacobi = false;
+	// fraction of the accumulated corrections applied, below 1 to damp atoms pushed from several sides at once
+	float jacobi_relaxation = 0.5f;
+	AlignedVector<float> correction_x;
+	AlignedVector<float> correction_y;
+	// speculative mode: contacts are solved at their time of impact along the objects motion during the substep,
+	// objects are binned with their radius widened by their substep displacement so that fast objects are found by
+	// the objects they may cross, fast streams then stay stable with fewer substeps
+	bool speculative = false;
+	// objects moving less than this per substep are binned with their radius only, the 3x3 neighborhood of the
+	// regular grid already holds every object they can reach, widening slow objects moves piles to coarse levels
+	float speculative_slop = 0.5f;
+	// widened radii are capped to this, faster objects can still tunnel
+	float speculative_max_radius = 4.0f;
+	AlignedVector<float> binning_radius;
+	// unit grid contacts kept across substeps and only found again where atoms changed cell, solved pair by pair
+	// in contact_cache.iterations passes, optionally warm started, not used in jacobi or speculative mode
+	bool contact_caching = false;
+	ContactCache contact_cache;
+	// unit size contacts found in verlet lists by TBroadphase, the lists and the unit grid are only rebuilt once an
+	// object has moved more than half the lists skin, coarse grids are still rebuilt every substep, not used with the
+	// other modes, on by default for a broadphase without grid and beginFrame throws if it is turned off
+	bool neighbor_lists = !TBroadphase::uses_grid;
+	TBroadphase neighbor_list;
+	// objects.op_count when the lists were built, it changes with any object added or removed
+	uint64_t lists_op_count = 0;
 	tp::ThreadPool& thread_pool;
+	std::vector<NeighborhoodBuffer> neighborhood_buffers;
+	std::vector<uint32_t> reorder_buffer;
 
-	PhysicSolver(IVec2 size, tp::ThreadPool& tp)
-		: grid{ size.x, size.y },
+	GenericPhysicSolver(IVec2 size, tp::ThreadPool& tp)
+		: obstacles{ size.x, size.y },
+		grid{ size.x, size.y },
+		grid_size{ size },
 		world_size(to<float>(size.x), to<float>(size.y)),
 		sub_steps{ 8 },
 		thread_pool{ tp }
 
 	{
-		grid.clear();
 	}
 
 	// checks if two atoms are colliding and if so create a new contact
 	void solveContact(uint32_t atom_1_idx, uint32_t atom_2_idx)
 	{
+		if (speculative)
+		{
+			solveSpeculativeContact(atom_1_idx, atom_2_idx);
+			return;
+		}
 		constexpr float response_coef = 1.0f;
 		constexpr float eps = 0.0001f;
-		PhysicObject& obj_1 = objects.data[atom_1_idx];
-		PhysicObject& obj_2 = objects.data[atom_2_idx];
-		const Vec2 o2_o1 = obj_1.position - obj_2.position;
+		const float* position_x = objects.position_x.data();
+		const float* position_y = objects.position_y.data();
+		const float radius_1 = objects.radius[atom_1_idx];
+		const float radius_2 = objects.radius[atom_2_idx];
+		const float min_dist = radius_1 + radius_2;
+		const Vec2 o2_o1 = { position_x[atom_1_idx] - position_x[atom_2_idx], position_y[atom_1_idx] - position_y[atom_2_idx] };
 		const float dist2 = o2_o1.x * o2_o1.x + o2_o1.y * o2_o1.y;
-		if (dist2 < 1.0f && dist2 > eps)
+		if (dist2 < min_dist * min_dist && dist2 > eps)
 		{
 			const float dist = sqrt(dist2);
-			// radius are al equal to 1.0f
-			const float delta = response_coef * 0.5f * (1.0f - dist);
+			// the overlap is shared according to the masses
+			const float mass_1 = radius_1 * radius_1;
+			const float mass_2 = radius_2 * radius_2;
+			const float delta = response_coef * (min_dist - dist) / (mass_1 + mass_2);
 			const Vec2 col_vec = (o2_o1 / dist) * delta;
-			obj_1.position += col_vec;
-			obj_2.position -= col_vec;
+			objects.displace(atom_1_idx, col_vec.x * mass_2, col_vec.y * mass_2);
+			objects.displace(atom_2_idx, -col_vec.x * mass_1, -col_vec.y * mass_1);
 		}
 	}
 
-	void checkAtomCellCollisions(uint32_t atom_idx, const CollisionCell& c)
+	// scalar version of ContactSolver speculative contacts
+	void solveSpeculativeContact(uint32_t atom_1_idx, uint32_t atom_2_idx)
 	{
-		for (uint32_t i{0}; i < c.objects_count; ++i)
+		const float* position_x = objects.position_x.data();
+		const float* position_y = objects.position_y.data();
+		const float radius_1 = objects.radius[atom_1_idx];
+		const float radius_2 = objects.radius[atom_2_idx];
+		const Vec2 last_position_1 = objects.getLastPosition(atom_1_idx);
+		const Vec2 last_position_2 = objects.getLastPosition(atom_2_idx);
+		simd::Scalar normal_x;
+		simd::Scalar normal_y;
+		const float depth = ContactSolver::getSpeculativeDepth<simd::Scalar>(
+			position_x[atom_1_idx] - position_x[atom_2_idx], position_y[atom_1_idx] - position_y[atom_2_idx],
+			last_position_1.x - last_position_2.x, last_position_1.y - last_position_2.y,
+			radius_1 + radius_2, normal_x, normal_y
+		).v;
+		if (depth > 0.0f)
 		{
-			solveContact(atom_idx, c.objects[i]);
+			const float mass_1 = radius_1 * radius_1;
+			const float mass_2 = radius_2 * radius_2;
+			const float delta = ContactSolver::response_coef * depth / (mass_1 + mass_2);
+			objects.displace(atom_1_idx, normal_x.v * delta * mass_2, normal_y.v * delta * mass_2);
+			objects.displace(atom_2_idx, -(normal_x.v * delta * mass_1), -(normal_y.v * delta * mass_1));
 		}
 	}
 
-	void processCell(const CollisionCell& c, uint32_t index)
+	// index of the grid holding objects of this radius, 0 is the unit grid
+	[[nodiscard]]
+	static uint32_t getLevel(float radius)
 	{
-		for (uint32_t i{0}; i < c.objects_count; ++i)
+		uint32_t level = 0;
+		for (float max_radius{PhysicObject::default_radius}; radius > max_radius; max_radius *= 2.0f)
 		{
-			const uint32_t atom_idx = c.objects[i];
-			checkAtomCellCollisions(atom_idx, grid.data[index - 1]);
-			checkAtomCellCollisions(atom_idx, grid.data[index]);
-			checkAtomCellCollisions(atom_idx, grid.data[index + 1]);
-			checkAtomCellCollisions(atom_idx, grid.data[index + grid.height - 1]);
-			checkAtomCellCollisions(atom_idx, grid.data[index + grid.height]);
-			checkAtomCellCollisions(atom_idx, grid.data[index + grid.height + 1]);
-			checkAtomCellCollisions(atom_idx, grid.data[index - grid.height - 1]);
-			checkAtomCellCollisions(atom_idx, grid.data[index - grid.height]);
-			checkAtomCellCollisions(atom_idx, grid.data[index - grid.height + 1]);
+			++level;
 		}
+		return level;
+	}
+
+	[[nodiscard]]
+	TGrid& getGrid(uint32_t level)
+	{
+		return level ? coarse_grids[level - 1] : grid;
 	}
 
-	void solveCollisionsThreaded(uint32_t start, uint32_t end)
+	// creates the coarse grids needed by objects of this radius
+	void addLevels(float radius)
 	{
-		for (uint32_t idx{start}; idx < end; ++idx)
+		const uint32_t level = getLevel(radius);
+		while (coarse_grids.size() < level)
 		{
-			processCell(grid.data[idx], idx);
+			const TGrid& finer = getGrid(to<uint32_t>(coarse_grids.size()));
+			coarse_grids.push_back(TGrid::createLevel(grid_size, finer.cell_size * 2.0f, finer.max_radius));
 		}
 	}
 
-	// find colliding atoms
-	void solveCollisions()
+	[[nodiscard]]
+	float getSleepSteps() const
+	{
+		return sleeping ? std::min(to<float>(sleep_steps), ParticleStore::max_rest_steps) : std::numeric_limits<float>::max();
+	}
+
+	// solves the cells of rows [row_begin, row_end) of a column
+	void processColumn(const TGrid& level_grid, const GridColumn& column, int32_t row_begin, int32_t row_end, NeighborhoodBuffer& buffer)
+	{
+		const int32_t x = column.x;
+		// columns with only sleeping atoms around them stay at rest
+		const std::vector<uint8_t>& column_awake = collision_tiles.column_awake;
+		if (!(column_awake[x - 1] | column_awake[x] | column_awake[x + 1]))
+		{
+			return;
+		}
+		row_begin = std::max(row_begin, column.first_row);
+		row_end = std::min(row_end, column.last_row + 1);
+		if (row_begin >= row_end)
+		{
+			return;
+		}
+		// only gather the rows around the atoms of the column
+		buffer.gather(objects, level_grid, x, to<uint32_t>(row_begin - 1), to<uint32_t>(row_end + 1), getSleepSteps(), speculative);
+		if (jacobi)
+		{
+			if (speculative)
+			{
+				ContactSolver::accumulateColumn<true>(buffer, correction_x.data(), correction_y.data());
+			}
+			else
+			{
+				ContactSolver::accumulateColumn(buffer, correction_x.data(), correction_y.data());
+			}
+			return;
+		}
+		if (speculative)
+		{
+			ContactSolver::solveColumn<true>(buffer);
+		}
+		else
+		{
+			ContactSolver::solveColumn(buffer);
+		}
+		buffer.scatter(objects);
+	}
+
+	void processTile(const TGrid& level_grid, uint32_t tile, NeighborhoodBuffer& buffer)
+	{
+		const IVec2 origin = collision_tiles.getOrigin(tile);
+		const int32_t size = collision_tiles.tile_size;
+		level_grid.forEachColumn(origin.x, origin.x + size, [&](const GridColumn& column) {
+			processColumn(level_grid, column, origin.y, origin.y + size, buffer);
+		});
+	}
+
+	// with a fixed tile size the result does not depend on the threads count
+	[[nodiscard]]
+	int32_t getTileSize() const
+	{
+		return deterministic && !tile_size ? deterministic_tile_size : to<int32_t>(tile_size);
+	}
+
+	// find colliding atoms of the same size class
+	void solveGridCollisions(const TGrid& level_grid)
 	{
-		// multi-thread grid
 		const uint32_t thread_count = thread_pool.thread_count_;
-		const uint32_t slice_count = thread_count * 2;
-		const uint32_t slice_size = (grid.width / slice_count) * grid.height;
-		const uint32_t last_cell = (2 * (thread_count - 1) + 2) * slice_size;
-		// find collions in two passes to avoid data races
-
-		// first collision pass 
-		for (uint32_t i{0}; i < thread_count; ++i)
-		{
-			thread_pool.addTask([this, i, slice_size] {
-				uint32_t const start{ 2 * i * slice_size };
-				uint32_t const end{ start + slice_size };
-				solveCollisionsThreaded(start, end);
-			});
+		collision_tiles.update(level_grid, getTileSize(), thread_count);
+		// one gather buffer per concurrent task, kept between substeps to avoid reallocations
+		neighborhood_buffers.resize(thread_count);
+		collision_tiles.updateColumnAwake(level_grid, objects, getSleepSteps(), thread_pool);
+		if (jacobi)
+		{
+			solveTilesJacobi(level_grid);
+			return;
 		}
-		// eventually process rest if the world is not divisible by the thread count
-		if (last_cell < grid.data.size())
+		collision_tiles.forEachTileByColor(thread_pool, [&](uint32_t tile, uint32_t task) {
+			processTile(level_grid, tile, neighborhood_buffers[task]);
+		});
+	}
+
+	[[nodiscard]]
+	bool isContactCacheUsed() const
+	{
+		return contact_caching && !jacobi && !speculative;
+	}
+
+	// unit grid contacts solved from the cache, all the warm starts first then the solving passes, all by tile colors
+	// the pairs of a column also move the next one, so a column is solved if either of them is awake
+	void solveCachedCollisions()
+	{
+		collision_tiles.update(grid, getTileSize(), thread_pool.thread_count_);
+		collision_tiles.updateColumnAwake(grid, objects, getSleepSteps(), thread_pool);
+		contact_cache.update(grid, thread_pool);
+		const std::vector<uint8_t>& column_awake = collision_tiles.column_awake;
+		const int32_t tile_columns = collision_tiles.tile_size;
+		// pass 0 is the warm start
+		for (uint32_t pass{contact_cache.warm_start > 0.0f ? 0u : 1u}; pass <= contact_cache.iterations; ++pass)
 		{
-			thread_pool.addTask([this, last_cell] {
-				solveCollisionsThreaded(last_cell, to<uint32_t>(grid.data.size()));
+			collision_tiles.forEachTileByColor(thread_pool, [&](uint32_t tile, uint32_t) {
+				const IVec2 origin = collision_tiles.getOrigin(tile);
+				grid.forEachColumn(origin.x, origin.x + tile_columns, [&](const GridColumn& column) {
+					if (!(column_awake[column.x] | column_awake[column.x + 1]))
+					{
+						return;
+					}
+					if (pass)
+					{
+						contact_cache.solveRows(objects, column.x, origin.y, origin.y + tile_columns, pass == 1);
+					}
+					else
+					{
+						contact_cache.warmStartRows(objects, column.x, origin.y, origin.y + tile_columns);
+					}
+				});
 			});
 		}
-		thread_pool.waitForCompletion();
-		// second collision pass 
-		for (uint32_t i{0}; i < thread_count; ++i)
+	}
+
+	[[nodiscard]]
+	bool isNeighborListUsed() const
+	{
+		return neighbor_lists && !contact_caching && !jacobi && !speculative;
+	}
+
+	// the lists stay valid while no object has moved more than half their skin since they were built
+	void solveNeighborListCollisions()
+	{
+		if (neighbor_list.isOutdated(objects, thread_pool))
 		{
-			thread_pool.addTask([this, i, slice_size] {
-				uint32_t const start{ (2 * i + 1) * slice_size };
-				uint32_t const end{ start + slice_size };
-				solveCollisionsThreaded(start, end);
+			buildNeighborLists(true);
+		}
+		neighbor_list.forEachPair(objects, grid, getSleepSteps(), getTileSize(), thread_pool, [this](uint32_t atom_1, uint32_t atom_2) {
+			solveContact(atom_1, atom_2);
+		});
+	}
+
+	// positions are only read, so all the tiles are grabbed from a single queue without waiting between colors
+	void solveTilesJacobi(const TGrid& level_grid)
+	{
+		const uint32_t thread_count = thread_pool.thread_count_;
+		uint32_t tiles_count = 0;
+		for (const std::vector<uint32_t>& color : collision_tiles.colors)
+		{
+			tiles_count += to<uint32_t>(color.size());
+		}
+		std::atomic<uint32_t> next_tile{ 0 };
+		const uint32_t task_count = std::min(thread_count, tiles_count);
+		for (uint32_t t{0}; t < task_count; ++t)
+		{
+			thread_pool.addTask([this, &level_grid, &next_tile, tiles_count, t] {
+				for (uint32_t i{next_tile++}; i < tiles_count; i = next_tile++)
+				{
+					uint32_t color = 0;
+					uint32_t tile = i;
+					for (; tile >= collision_tiles.colors[color].size(); ++color)
+					{
+						tile -= to<uint32_t>(collision_tiles.colors[color].size());
+					}
+					processTile(level_grid, collision_tiles.colors[color][tile], neighborhood_buffers[t]);
+				}
 			});
 		}
 		thread_pool.waitForCompletion();
 	}
 
+	// moves the objects by their accumulated corrections and clears them for the next pass
+	void applyCorrections()
+	{
+		thread_pool.dispatch(to<uint32_t>(objects.size()), [&](uint32_t start, uint32_t end) {
+			for (uint32_t i{start}; i < end; ++i)
+			{
+				objects.displace(i, correction_x[i] * jacobi_relaxation, correction_y[i] * jacobi_relaxation);
+				correction_x[i] = 0.0f;
+				correction_y[i] = 0.0f;
+			}
+		});
+	}
+
+	// contacts between atoms of different size classes, each coarse atom looks for
+	// finer atoms in the finer grids cells its radius plus their max radius can reach
+	// coarse atoms are expected to be few so this pass is single threaded
+	void solveCrossLevelCollisions()
+	{
+		const float steps = getSleepSteps();
+		for (uint32_t level{1}; level <= coarse_grids.size(); ++level)
+		{
+			for (const uint32_t coarse_atom : getGrid(level).atoms)
+			{
+				const bool coarse_awake = objects.isAwake(coarse_atom, steps);
+				for (uint32_t finer_level{0}; finer_level < level; ++finer_level)
+				{
+					const TGrid& finer = getGrid(finer_level);
+					float reach = getBinningRadius()[coarse_atom] + finer.max_radius;
+					// the unit grid may be from a previous substep, its atoms moved at most half the skin since
+					if (!finer_level && isNeighborListUsed())
+					{
+						reach += 0.5f * neighbor_list.skin;
+					}
+					const float x = objects.position_x[coarse_atom];
+					const float y = objects.position_y[coarse_atom];
+					const IVec2 cell_min = finer.getCellCoords(x - reach, y - reach);
+					const IVec2 cell_max = finer.getCellCoords(x + reach, y + reach);
+					for (int32_t cx{std::max(cell_min.x, 0)}; cx <= std::min(cell_max.x, finer.width - 1); ++cx)
+					{
+						for (int32_t cy{std::max(cell_min.y, 0)}; cy <= std::min(cell_max.y, finer.height - 1); ++cy)
+						{
+							const CollisionCell cell = finer.getCell(cx, cy);
+							for (uint32_t i{0}; i < cell.objects_count; ++i)
+							{
+								if (coarse_awake || objects.isAwake(cell.objects[i], steps))
+								{
+									solveContact(coarse_atom, cell.objects[i]);
+								}
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+
+	void solveCollisions()
+	{
+		if (jacobi)
+		{
+			// corrections are cleared once applied, only new objects need zeroing
+			correction_x.resize(objects.size(), 0.0f);
+			correction_y.resize(objects.size(), 0.0f);
+		}
+		if (isContactCacheUsed())
+		{
+			solveCachedCollisions();
+		}
+		else if (isNeighborListUsed())
+		{
+			solveNeighborListCollisions();
+		}
+		else
+		{
+			solveGridCollisions(grid);
+		}
+		for (const TGrid& coarse_grid : coarse_grids)
+		{
+			solveGridCollisions(coarse_grid);
+		}
+		if (jacobi)
+		{
+			applyCorrections();
+		}
+		solveCrossLevelCollisions();
+	}
+
 	// add a new object to the solver 
 	uint64_t addObject(const PhysicObject& object)
 	{
+		addLevels(object.radius);
 		return objects.push_back(object);
 	}
 
 	// add a new object to the solver
-	uint64_t createObject(Vec2 pos)
+	uint64_t createObject(Vec2 pos, float radius = PhysicObject::default_radius)
+	{
+		addLevels(radius);
+		return objects.emplace_back(pos, radius);
+	}
+
+	// objects of the batch are contiguous in data order until the next update or erase
+	ObjectBatch createObjects(const std::vector<Vec2>& positions, float radius = PhysicObject::default_radius)
+	{
+		addLevels(radius);
+		return objects.emplace_back(positions.data(), positions.size(), radius, thread_pool);
+	}
+
+	void removeObjects(const std::vector<civ::ID>& ids)
+	{
+		objects.erase(ids.data(), ids.size());
+	}
+
+	// links two objects at their current distance
+	civ::ID createLink(civ::ID object_1, civ::ID object_2, float stiffness = 1.0f)
+	{
+		return links.createLink(objects, object_1, object_2, stiffness);
+	}
+
+	void createLinks(const std::vector<std::pair<civ::ID, civ::ID>>& pairs, float stiffness = 1.0f)
 	{
-		return objects.emplace_back(pos);
+		links.createLinks(objects, pairs, stiffness);
 	}
 
 	void update(float dt)
 	{
-		// perform the sub steps 
-		const float sub_dt = dt / static_cast<float>(sub_steps);
+		const float sub_dt = beginFrame(dt);
 		for (uint32_t i(sub_steps); i--;)
 		{
+			updateSubStep(sub_dt, i > 0);
+		}
+	}
+
+	// work done once per frame before its substeps: substeps count and duration, grids, spatial sort, neighbor lists,
+	// links and long range forces, returns the substep duration
+	float beginFrame(float dt)
+	{
+		// the grid path would silently replace a broadphase that does not use the grid
+		if (!TBroadphase::uses_grid && !isNeighborListUsed())
+		{
+			throw std::runtime_error("this broadphase only supports the neighbor lists mode, without contact caching, jacobi or speculative contacts");
+		}
+		if (adaptive_sub_steps)
+		{
+			updateSubSteps(dt);
+		}
+		const float sub_dt = dt / static_cast<float>(sub_steps);
+		// verlet velocities are distances per step, they have to follow step changes
+		if (last_sub_dt > 0.0f && sub_dt != last_sub_dt)
+		{
+			scaleVelocities(sub_dt / last_sub_dt);
+		}
+		last_sub_dt = sub_dt;
+		// fast objects are binned in the coarse grids
+		if (speculative)
+		{
+			addLevels(speculative_max_radius);
+		}
+		const bool reorder = reorder_period && (++frame_count % reorder_period == 0);
+		if (isNeighborListUsed())
+		{
+			beginNeighborListFrame(reorder);
+		}
+		else
+		{
+			// objects may have been added, removed or moved since the last frame
 			addObjectsToGrid();
-			solveCollisions();
+			if (reorder)
+			{
+				reorderObjects();
+			}
+		}
+		links.update(objects, thread_pool);
+		if (long_range_forces.isActive())
+		{
+			long_range_forces.update(objects, std::max(world_size.x, world_size.y), thread_pool);
+		}
+		return sub_dt;
+	}
+
+	// one substep of the frame, bin_next bins the objects for the next substep of the same frame
+	void updateSubStep(float sub_dt, bool bin_next)
+	{
+		solveCollisions();
+		links.solve(objects, thread_pool);
+		// the unit grid is only rebuilt along with the neighbor lists
+		if (isNeighborListUsed())
+		{
 			updateObjects_multi(sub_dt);
+			if (bin_next && isGridOutdated())
+			{
+				buildCoarseGrids();
+			}
+		}
+		// the integration pass also bins the objects for the next substep, saving one pass over them
+		else if (bin_next && isGridOutdated())
+		{
+			updateObjectsAndGrids(sub_dt);
+		}
+		else
+		{
+			updateObjects_multi(sub_dt);
+		}
+	}
+
+	// to be called between two substeps when objects were added, removed or moved by the caller, the grids and
+	// lists are rebuilt and the links and long range forces follow the new objects indices without being recomputed
+	void syncObjects()
+	{
+		updateBinningRadius();
+		buildCoarseGrids();
+		if (isNeighborListUsed())
+		{
+			buildNeighborLists(true);
+		}
+		else
+		{
+			buildGrid();
+		}
+		links.update(objects, thread_pool);
+		if (long_range_forces.isActive())
+		{
+			long_range_forces.followObjects(objects, thread_pool);
+		}
+	}
+
+	// checksum of the objects state, equal across threads counts in deterministic mode
+	[[nodiscard]]
+	uint64_t getChecksum() const
+	{
+		return objects.getChecksum();
+	}
+
+	// parallel max reduction of the distance travelled by the objects during the last step
+	[[nodiscard]]
+	float getMaxDisplacement()
+	{
+		return std::sqrt(reduction.getMax(to<uint32_t>(objects.size()), thread_pool, [&](uint32_t start, uint32_t end) {
+			return VerletIntegrator::getMaxDisplacement2(objects, start, end);
+		}));
+	}
+
+	// picks the substeps count from the distance the fastest object would travel during this frame
+	void updateSubSteps(float dt)
+	{
+		const float steps_per_frame = last_sub_dt > 0.0f ? dt / last_sub_dt : to<float>(sub_steps);
+		const float frame_displacement = getMaxDisplacement() * steps_per_frame;
+		const auto needed_sub_steps = to<uint32_t>(std::ceil(frame_displacement / max_sub_step_displacement));
+		sub_steps = std::clamp(needed_sub_steps, min_sub_steps, max_sub_steps);
+	}
+
+	void scaleVelocities(float ratio)
+	{
+		thread_pool.dispatch(to<uint32_t>(objects.size()), [&](uint32_t start, uint32_t end) {
+			VerletIntegrator::scaleVelocity(objects, start, end, ratio);
+		});
+	}
+
+	// sleeping objects do not move so the grid only needs a rebuild if an object is awake or has been added or removed
+	[[nodiscard]]
+	bool isGridOutdated() const
+	{
+		const float steps = getSleepSteps();
+		return grid.atom_cell.size() != objects.size() ||
+			(speculative && binning_radius.size() != objects.size()) ||
+			std::any_of(objects.rest_steps.begin(), objects.rest_steps.begin() + objects.size(), [steps](float rest) { return rest < steps; });
+	}
+
+	// lists refer to objects indices, so they are rebuilt here when objects were added, removed or reordered,
+	// otherwise they are kept across frames until solveNeighborListCollisions finds them outdated
+	void beginNeighborListFrame(bool reorder)
+	{
+		if (reorder)
+		{
+			// the objects are sorted in the order of an up to date grid
+			buildGrid();
+			reorderObjects();
+			buildNeighborLists(false);
+			return;
 		}
+		if (objects.op_count != lists_op_count)
+		{
+			buildNeighborLists(true);
+		}
+		if (isGridOutdated())
+		{
+			buildCoarseGrids();
+		}
+	}
+
+	// build_grid rebuilds the unit grid first if the lists or the cross level contacts need it, the cross level
+	// contacts then see it at the positions the lists were built from
+	void buildNeighborLists(bool build_grid)
+	{
+		if (build_grid && (TBroadphase::uses_grid || !coarse_grids.empty()))
+		{
+			buildGrid();
+		}
+		neighbor_list.build(objects, grid, thread_pool);
+		lists_op_count = objects.op_count;
 	}
 
 	void addObjectsToGrid()
 	{
-		grid.clear();
-		// safety border to avoid adding object outside the grid
-		uint32_t i{ 0 };
-		for (const PhysicObject& obj : objects.data)
+		if (!isGridOutdated())
 		{
-			if (obj.position.x > 1.0f && obj.position.x < world_size.x - 1.0f && 
-				obj.position.y > 1.0f && obj.position.y < world_size.y - 1.0f)
+			return;
+		}
+		updateBinningRadius();
+		buildGrid();
+		buildCoarseGrids();
+	}
+
+	void buildGrid()
+	{
+		grid.build(objects.position_x.data(), objects.position_y.data(), getBinningRadius(), to<uint32_t>(objects.size()), thread_pool);
+		if (deterministic)
+		{
+			grid.sortCells(thread_pool);
+		}
+	}
+
+	// radii the objects are binned with, widened in speculative mode
+	[[nodiscard]]
+	const float* getBinningRadius() const
+	{
+		return speculative ? binning_radius.data() : objects.radius.data();
+	}
+
+	void updateBinningRadius(uint32_t start, uint32_t end)
+	{
+		for (uint32_t i{start}; i < end; ++i)
+		{
+			const Vec2 move = objects.getVelocity(i);
+			const float displacement = std::sqrt(move.x * move.x + move.y * move.y);
+			const float radius = objects.radius[i];
+			binning_radius[i] = displacement > speculative_slop ? std::max(std::min(radius + displacement, speculative_max_radius), radius) : radius;
+		}
+	}
+
+	void updateBinningRadius()
+	{
+		if (!speculative)
+		{
+			return;
+		}
+		binning_radius.resize(objects.size());
+		thread_pool.dispatch(to<uint32_t>(objects.size()), [&](uint32_t start, uint32_t end) {
+			updateBinningRadius(start, end);
+		});
+	}
+
+	void binObjects(uint32_t start, uint32_t end)
+	{
+		grid.bin(objects.position_x.data(), objects.position_y.data(), getBinningRadius(), start, end);
+		for (TGrid& coarse_grid : coarse_grids)
+		{
+			coarse_grid.bin(objects.position_x.data(), objects.position_y.data(), getBinningRadius(), start, end);
+		}
+	}
+
+	void buildCoarseGrids()
+	{
+		for (TGrid& coarse_grid : coarse_grids)
+		{
+			coarse_grid.build(objects.position_x.data(), objects.position_y.data(), getBinningRadius(), to<uint32_t>(objects.size()), thread_pool);
+			if (deterministic)
 			{
-				grid.addAtom(to<int32_t>(obj.position.x), to<int32_t>(obj.position.y), i);
+				coarse_grid.sortCells(thread_pool);
 			}
-			++i;
+		}
+	}
+
+	// sorts objects in grid order so that neighbors are close in memory
+	void reorderObjects()
+	{
+		const uint32_t objects_count = to<uint32_t>(objects.size());
+		reorder_buffer.resize(objects_count);
+		std::copy(grid.atoms.begin(), grid.atoms.end(), reorder_buffer.begin());
+		// objects outside of the grid, or in a coarse one, go last
+		uint32_t next = to<uint32_t>(grid.atoms.size());
+		for (uint32_t i{0}; i < objects_count; ++i)
+		{
+			if (grid.atom_cell[i] == TGrid::invalid_cell)
+			{
+				reorder_buffer[next++] = i;
+			}
+		}
+		objects.reorder(reorder_buffer, thread_pool);
+		grid.applyOrder(reorder_buffer, thread_pool);
+		updateBinningRadius();
+		buildCoarseGrids();
+	}
+
+	[[nodiscard]]
+	VerletIntegrator::Parameters getIntegratorParameters(float dt) const
+	{
+		// apply map borders collisions, default objects centers stay 2 units away from the borders
+		const float margin = 2.0f - PhysicObject::default_radius;
+		const Vec2 min_position = { margin, margin };
+		VerletIntegrator::Parameters parameters = { gravity, min_position, world_size - min_position, dt, sleep_speed * dt, wake_speed * dt, getSleepSteps() };
+		if (long_range_forces.isActive())
+		{
+			parameters.acceleration_x = long_range_forces.acceleration_x.data();
+			parameters.acceleration_y = long_range_forces.acceleration_y.data();
+		}
+		return parameters;
+	}
+
+	// done right after the integration, along with the world borders
+	void collideObstacles(uint32_t start, uint32_t end)
+	{
+		if (!obstacles.empty())
+		{
+			obstacles.collide(objects, start, end);
 		}
 	}
 
 	void updateObjects_multi(float dt)
 	{
-		thread_pool.dispatch(to<uint32_t>(objects.size()), [&](uint32_t start, uint32_t end) {
-			for (uint32_t i{start}; i < end; ++i)
+		const VerletIntegrator::Parameters parameters = getIntegratorParameters(dt);
+		// dispatch whole SIMD blocks so every range starts on an aligned index
+		const uint32_t objects_count = to<uint32_t>(objects.size());
+		const uint32_t block_count = (objects_count + simd::width - 1) / simd::width;
+		thread_pool.dispatch(block_count, [&](uint32_t start, uint32_t end) {
+			const uint32_t first = start * simd::width;
+			const uint32_t last = std::min(end * simd::width, objects_count);
+			VerletIntegrator::integrate(objects, first, last, parameters);
+			collideObstacles(first, last);
+		});
+	}
+
+	// updateObjects_multi followed by addObjectsToGrid in a single pass over the objects
+	void updateObjectsAndGrids(float dt)
+	{
+		const VerletIntegrator::Parameters parameters = getIntegratorParameters(dt);
+		const uint32_t objects_count = to<uint32_t>(objects.size());
+		binning_radius.resize(speculative ? objects_count : 0);
+		grid.beginBuild(objects_count, thread_pool);
+		for (TGrid& coarse_grid : coarse_grids)
+		{
+			coarse_grid.beginBuild(objects_count, thread_pool);
+		}
+		const uint32_t chunk_count = (objects_count + bin_chunk_size - 1) / bin_chunk_size;
+		thread_pool.dispatch(chunk_count, [&](uint32_t start, uint32_t end) {
+			for (uint32_t c{start}; c < end; ++c)
 			{
-				PhysicObject& obj = objects.data[i];
-				// add gravity 
-				obj.acceleration += gravity;
-				// apply verlet integration
-				obj.update(dt);
-				// apply map borders collisions
-				const float margin = 2.0f;
-				if (obj.position.x > world_size.x - margin)
-				{
-					obj.position.x = world_size.x - margin;
-				}
-				else if (obj.position.x < margin)
-				{
-					obj.position.x = margin;
-				}
-				if (obj.position.y > world_size.y - margin)
-				{
-					obj.position.y = world_size.y - margin;
-				}
-				else if (obj.position.y < margin)
+				const uint32_t first = c * bin_chunk_size;
+				const uint32_t last = std::min(objects_count, first + bin_chunk_size);
+				VerletIntegrator::integrate(objects, first, last, parameters);
+				collideObstacles(first, last);
+				if (speculative)
 				{
-					obj.position.y = margin;
+					updateBinningRadius(first, last);
 				}
+				binObjects(first, last);
 			}
 		});
+		grid.endBuild(objects_count, thread_pool);
+		for (TGrid& coarse_grid : coarse_grids)
+		{
+			coarse_grid.endBuild(objects_count, thread_pool);
+		}
+		if (deterministic)
+		{
+			grid.sortCells(thread_pool);
+			for (TGrid& coarse_grid : coarse_grids)
+			{
+				coarse_grid.sortCells(thread_pool);
+			}
+		}
 	}
 };
+
+using PhysicSolver = GenericPhysicSolver<CollisionGrid>;
+// for large and mostly empty worlds, memory and grid building costs do not depend on the world area
+using SparsePhysicSolver = GenericPhysicSolver<SparseCollisionGrid>;
+// neighbor lists found by sweep and prune, with neighbor_lists set, for long thin layouts covering few grid cells
+using SweepAndPrunePhysicSolver = GenericPhysicSolver<CollisionGrid, SweepAndPrune>;
 #endif // !PHYSICS
@@ -0,0 +1,77 @@
+#ifndef RADIXSORT_H
+#define RADIXSORT_H
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "engine/common/utils.hpp"
+#include "thread_pool/thread_pool.hpp"
+
+// stable parallel LSD radix sort of keys and the values attached to them
+// the input is split in fixed size chunks, each chunk counts its digits then scatters them after the same digits
+// of the previous chunks, the result does not depend on the threads count
+struct RadixSort
+{
+	// elements processed by one sort task
+	static constexpr uint32_t chunk_size = 4096;
+	static constexpr uint32_t radix_bits = 8;
+	static constexpr uint32_t radix_size = 1 << radix_bits;
+
+	std::vector<uint32_t> key_swap;
+	std::vector<uint32_t> value_swap;
+	std::vector<uint32_t> chunk_histogram;
+
+	// sorts keys and values by key, only the digits needed by max_key are sorted
+	void sort(std::vector<uint32_t>& keys, std::vector<uint32_t>& values, uint32_t max_key, tp::ThreadPool& thread_pool)
+	{
+		const uint32_t count = to<uint32_t>(keys.size());
+		const uint32_t chunk_count = (count + chunk_size - 1) / chunk_size;
+		chunk_histogram.resize(chunk_count * radix_size);
+		key_swap.resize(count);
+		value_swap.resize(count);
+		for (uint32_t shift{0}; shift < 32 && (max_key >> shift); shift += radix_bits)
+		{
+			// digits histogram of each chunk
+			thread_pool.dispatch(chunk_count, [&](uint32_t start, uint32_t end) {
+				for (uint32_t c{start}; c < end; ++c)
+				{
+					uint32_t* histogram = chunk_histogram.data() + c * radix_size;
+					std::fill(histogram, histogram + radix_size, 0);
+					const uint32_t last = std::min(count, (c + 1) * chunk_size);
+					for (uint32_t i{c * chunk_size}; i < last; ++i)
+					{
+						++histogram[(keys[i] >> shift) & (radix_size - 1)];
+					}
+				}
+			});
+			// each chunk writes its digits after the same digits of the previous chunks
+			uint32_t sum = 0;
+			for (uint32_t d{0}; d < radix_size; ++d)
+			{
+				for (uint32_t c{0}; c < chunk_count; ++c)
+				{
+					const uint32_t digit_count = chunk_histogram[c * radix_size + d];
+					chunk_histogram[c * radix_size + d] = sum;
+					sum += digit_count;
+				}
+			}
+			thread_pool.dispatch(chunk_count, [&](uint32_t start, uint32_t end) {
+				for (uint32_t c{start}; c < end; ++c)
+				{
+					uint32_t* cursor = chunk_histogram.data() + c * radix_size;
+					const uint32_t last = std::min(count, (c + 1) * chunk_size);
+					for (uint32_t i{c * chunk_size}; i < last; ++i)
+					{
+						const uint32_t slot = cursor[(keys[i] >> shift) & (radix_size - 1)]++;
+						key_swap[slot] = keys[i];
+						value_swap[slot] = values[i];
+					}
+				}
+			});
+			std::swap(keys, key_swap);
+			std::swap(values, value_swap);
+		}
+	}
+};
+#endif // !RADIXSORT_H
@@ -0,0 +1,332 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cstdint>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+// widest instruction set enabled at compile time, MSVC does not define __SSE2__ on x64
+#if defined(__AVX512F__)
+#define POLYMAT_SIMD_AVX512
+#elif defined(__AVX__) || defined(__AVX2__)
+#define POLYMAT_SIMD_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define POLYMAT_SIMD_SSE
+#endif
+
+// half floats conversions, MSVC does not define __F16C__ but every AVX2 CPU has it
+#if (defined(POLYMAT_SIMD_AVX512) || defined(POLYMAT_SIMD_AVX)) && (defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__)))
+#define POLYMAT_SIMD_F16C
+#endif
+
+#if defined(POLYMAT_SIMD_AVX512) || defined(POLYMAT_SIMD_AVX)
+#include <immintrin.h>
+#elif defined(POLYMAT_SIMD_SSE)
+#include <emmintrin.h>
+#endif
+
+namespace simd
+{
+	// IEEE half float bits of f, rounded to nearest even
+	inline uint16_t toHalf(float f)
+	{
+#if defined(POLYMAT_SIMD_F16C)
+		return static_cast<uint16_t>(_cvtss_sh(f, _MM_FROUND_TO_NEAREST_INT));
+#else
+		uint32_t bits;
+		std::memcpy(&bits, &f, sizeof(bits));
+		const auto sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+		const uint32_t magnitude = bits & 0x7FFFFFFF;
+		// too large for a half, or infinity and NaN
+		if (magnitude >= 0x47800000)
+		{
+			return static_cast<uint16_t>(sign | (magnitude > 0x7F800000 ? 0x7E00 : 0x7C00));
+		}
+		// subnormal halves, adding 0.5 leaves the value in the mantissa with a 2^-24 step
+		if (magnitude < 0x38800000)
+		{
+			float magnitude_f;
+			std::memcpy(&magnitude_f, &magnitude, sizeof(magnitude_f));
+			const float shifted = magnitude_f + 0.5f;
+			uint32_t shifted_bits;
+			std::memcpy(&shifted_bits, &shifted, sizeof(shifted_bits));
+			return static_cast<uint16_t>(sign | (shifted_bits - 0x3F000000));
+		}
+		// rebias the exponent and round the 13 dropped bits, a carry into the exponent is the right result
+		const uint32_t rounded = magnitude + 0xFFF + ((magnitude >> 13) & 1);
+		return static_cast<uint16_t>(sign | ((rounded - 0x38000000) >> 13));
+#endif
+	}
+
+	inline float fromHalf(uint16_t h)
+	{
+#if defined(POLYMAT_SIMD_F16C)
+		return _cvtsh_ss(h);
+#else
+		const uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+		const uint32_t exponent = (h >> 10) & 0x1F;
+		const uint32_t mantissa = h & 0x3FF;
+		if (exponent == 0)
+		{
+			const float value = static_cast<float>(mantissa) * 5.9604645e-8f;
+			return sign ? -value : value;
+		}
+		const uint32_t bits = sign | (exponent == 0x1F ? 0x7F800000 | (mantissa << 13) : ((exponent + 112) << 23) | (mantissa << 13));
+		float value;
+		std::memcpy(&value, &bits, sizeof(value));
+		return value;
+#endif
+	}
+
+	// lane by lane half floats conversions for the vector types without hardware support
+	template<typename TFloat>
+	TFloat loadHalfLanes(const uint16_t* p)
+	{
+		alignas(64) float lanes[TFloat::width];
+		for (uint32_t k{0}; k < TFloat::width; ++k)
+		{
+			lanes[k] = fromHalf(p[k]);
+		}
+		return TFloat::load(lanes);
+	}
+
+	template<typename TFloat>
+	void storeHalfLanes(TFloat v, uint16_t* p)
+	{
+		alignas(64) float lanes[TFloat::width];
+		v.store(lanes);
+		for (uint32_t k{0}; k < TFloat::width; ++k)
+		{
+			p[k] = toHalf(lanes[k]);
+		}
+	}
+
+	// lane by lane conversions of small counters stored on one byte, values have to be in [0, 255]
+	template<typename TFloat>
+	TFloat loadByteLanes(const uint8_t* p)
+	{
+		alignas(64) float lanes[TFloat::width];
+		for (uint32_t k{0}; k < TFloat::width; ++k)
+		{
+			lanes[k] = static_cast<float>(p[k]);
+		}
+		return TFloat::load(lanes);
+	}
+
+	template<typename TFloat>
+	void storeByteLanes(TFloat v, uint8_t* p)
+	{
+		alignas(64) float lanes[TFloat::width];
+		v.store(lanes);
+		for (uint32_t k{0}; k < TFloat::width; ++k)
+		{
+			p[k] = static_cast<uint8_t>(lanes[k]);
+		}
+	}
+
+	// register whose lane k holds start + k, exact while start + k stays below 2^24
+	template<typename TFloat>
+	TFloat laneIndices(uint32_t start)
+	{
+		alignas(64) float lanes[TFloat::width];
+		for (uint32_t k{0}; k < TFloat::width; ++k)
+		{
+			lanes[k] = static_cast<float>(start + k);
+		}
+		return TFloat::load(lanes);
+	}
+
+	// every vector type exposes the same interface so kernels can be written once
+	// as templates and instantiated for the native width and for the scalar tail
+	struct Scalar
+	{
+		using Mask = bool;
+		static constexpr uint32_t width = 1;
+
+		float v;
+
+		Scalar() = default;
+		Scalar(float v_) : v(v_) { }
+
+		static Scalar load(const float* p) { return { *p }; }
+		static Scalar loadUnaligned(const float* p) { return { *p }; }
+		static Scalar broadcast(float f) { return { f }; }
+		void store(float* p) const { *p = v; }
+		void storeUnaligned(float* p) const { *p = v; }
+		static Scalar loadHalf(const uint16_t* p) { return { fromHalf(*p) }; }
+		void storeHalf(uint16_t* p) const { *p = toHalf(v); }
+		static Scalar loadBytes(const uint8_t* p) { return { static_cast<float>(*p) }; }
+		void storeBytes(uint8_t* p) const { *p = static_cast<uint8_t>(v); }
+
+		friend Scalar operator+(Scalar a, Scalar b) { return { a.v + b.v }; }
+		friend Scalar operator-(Scalar a, Scalar b) { return { a.v - b.v }; }
+		friend Scalar operator*(Scalar a, Scalar b) { return { a.v * b.v }; }
+		friend Scalar operator/(Scalar a, Scalar b) { return { a.v / b.v }; }
+		friend Scalar min(Scalar a, Scalar b) { return { std::min(a.v, b.v) }; }
+		friend Scalar max(Scalar a, Scalar b) { return { std::max(a.v, b.v) }; }
+		friend Scalar sqrt(Scalar a) { return { std::sqrt(a.v) }; }
+		friend Scalar rsqrt(Scalar a) { return { 1.0f / std::sqrt(a.v) }; }
+		friend Mask lessThan(Scalar a, Scalar b) { return a.v < b.v; }
+		friend Mask greaterThan(Scalar a, Scalar b) { return a.v > b.v; }
+		static Mask maskAnd(Mask a, Mask b) { return a && b; }
+		friend Scalar select(Mask m, Scalar a, Scalar b) { return m ? a : b; }
+		static uint32_t toBits(Mask m) { return m ? 1u : 0u; }
+		friend float reduceAdd(Scalar a) { return a.v; }
+		friend float reduceMax(Scalar a) { return a.v; }
+	};
+
+#if defined(POLYMAT_SIMD_AVX512)
+	struct Float
+	{
+		using Mask = __mmask16;
+		static constexpr uint32_t width = 16;
+
+		__m512 v;
+
+		Float() = default;
+		Float(__m512 v_) : v(v_) { }
+
+		static Float load(const float* p) { return _mm512_load_ps(p); }
+		static Float loadUnaligned(const float* p) { return _mm512_loadu_ps(p); }
+		static Float broadcast(float f) { return _mm512_set1_ps(f); }
+		void store(float* p) const { _mm512_store_ps(p, v); }
+		void storeUnaligned(float* p) const { _mm512_storeu_ps(p, v); }
+		static Float loadHalf(const uint16_t* p) { return _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p))); }
+		void storeHalf(uint16_t* p) const { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), _mm512_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT)); }
+		static Float loadBytes(const uint8_t* p) { return _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)))); }
+		void storeBytes(uint8_t* p) const { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm512_cvtusepi32_epi8(_mm512_cvttps_epi32(v))); }
+
+		friend Float operator+(Float a, Float b) { return _mm512_add_ps(a.v, b.v); }
+		friend Float operator-(Float a, Float b) { return _mm512_sub_ps(a.v, b.v); }
+		friend Float operator*(Float a, Float b) { return _mm512_mul_ps(a.v, b.v); }
+		friend Float operator/(Float a, Float b) { return _mm512_div_ps(a.v, b.v); }
+		friend Float min(Float a, Float b) { return _mm512_min_ps(a.v, b.v); }
+		friend Float max(Float a, Float b) { return _mm512_max_ps(a.v, b.v); }
+		friend Float sqrt(Float a) { return _mm512_sqrt_ps(a.v); }
+		friend Float rsqrt(Float a) { return _mm512_rsqrt14_ps(a.v); }
+		friend Mask lessThan(Float a, Float b) { return _mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ); }
+		friend Mask greaterThan(Float a, Float b) { return _mm512_cmp_ps_mask(a.v, b.v, _CMP_GT_OQ); }
+		static Mask maskAnd(Mask a, Mask b) { return a & b; }
+		friend Float select(Mask m, Float a, Float b) { return _mm512_mask_blend_ps(m, b.v, a.v); }
+		static uint32_t toBits(Mask m) { return static_cast<uint32_t>(m); }
+		friend float reduceAdd(Float a) { return _mm512_reduce_add_ps(a.v); }
+		friend float reduceMax(Float a) { return _mm512_reduce_max_ps(a.v); }
+	};
+#elif defined(POLYMAT_SIMD_AVX)
+	struct Float
+	{
+		using Mask = __m256;
+		static constexpr uint32_t width = 8;
+
+		__m256 v;
+
+		Float() = default;
+		Float(__m256 v_) : v(v_) { }
+
+		static Float load(const float* p) { return _mm256_load_ps(p); }
+		static Float loadUnaligned(const float* p) { return _mm256_loadu_ps(p); }
+		static Float broadcast(float f) { return _mm256_set1_ps(f); }
+		void store(float* p) const { _mm256_store_ps(p, v); }
+		void storeUnaligned(float* p) const { _mm256_storeu_ps(p, v); }
+#if defined(POLYMAT_SIMD_F16C)
+		static Float loadHalf(const uint16_t* p) { return _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))); }
+		void storeHalf(uint16_t* p) const { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT)); }
+#else
+		static Float loadHalf(const uint16_t* p) { return loadHalfLanes<Float>(p); }
+		void storeHalf(uint16_t* p) const { storeHalfLanes(*this, p); }
+#endif
+#if defined(__AVX2__)
+		static Float loadBytes(const uint8_t* p) { return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)))); }
+#else
+		static Float loadBytes(const uint8_t* p) { return loadByteLanes<Float>(p); }
+#endif
+		void storeBytes(uint8_t* p) const { storeByteLanes(*this, p); }
+
+		friend Float operator+(Float a, Float b) { return _mm256_add_ps(a.v, b.v); }
+		friend Float operator-(Float a, Float b) { return _mm256_sub_ps(a.v, b.v); }
+		friend Float operator*(Float a, Float b) { return _mm256_mul_ps(a.v, b.v); }
+		friend Float operator/(Float a, Float b) { return _mm256_div_ps(a.v, b.v); }
+		friend Float min(Float a, Float b) { return _mm256_min_ps(a.v, b.v); }
+		friend Float max(Float a, Float b) { return _mm256_max_ps(a.v, b.v); }
+		friend Float sqrt(Float a) { return _mm256_sqrt_ps(a.v); }
+		friend Float rsqrt(Float a) { return _mm256_rsqrt_ps(a.v); }
+		friend Mask lessThan(Float a, Float b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+		friend Mask greaterThan(Float a, Float b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+		static Mask maskAnd(Mask a, Mask b) { return _mm256_and_ps(a, b); }
+		friend Float select(Mask m, Float a, Float b) { return _mm256_blendv_ps(b.v, a.v, m); }
+		static uint32_t toBits(Mask m) { return static_cast<uint32_t>(_mm256_movemask_ps(m)); }
+		friend float reduceAdd(Float a)
+		{
+			const __m128 sum_4 = _mm_add_ps(_mm256_castps256_ps128(a.v), _mm256_extractf128_ps(a.v, 1));
+			const __m128 sum_2 = _mm_add_ps(sum_4, _mm_movehl_ps(sum_4, sum_4));
+			return _mm_cvtss_f32(_mm_add_ss(sum_2, _mm_shuffle_ps(sum_2, sum_2, 1)));
+		}
+		friend float reduceMax(Float a)
+		{
+			const __m128 max_4 = _mm_max_ps(_mm256_castps256_ps128(a.v), _mm256_extractf128_ps(a.v, 1));
+			const __m128 max_2 = _mm_max_ps(max_4, _mm_movehl_ps(max_4, max_4));
+			return _mm_cvtss_f32(_mm_max_ss(max_2, _mm_shuffle_ps(max_2, max_2, 1)));
+		}
+	};
+#elif defined(POLYMAT_SIMD_SSE)
+	struct Float
+	{
+		using Mask = __m128;
+		static constexpr uint32_t width = 4;
+
+		__m128 v;
+
+		Float() = default;
+		Float(__m128 v_) : v(v_) { }
+
+		static Float load(const float* p) { return _mm_load_ps(p); }
+		static Float loadUnaligned(const float* p) { return _mm_loadu_ps(p); }
+		static Float broadcast(float f) { return _mm_set1_ps(f); }
+		void store(float* p) const { _mm_store_ps(p, v); }
+		void storeUnaligned(float* p) const { _mm_storeu_ps(p, v); }
+		static Float loadHalf(const uint16_t* p) { return loadHalfLanes<Float>(p); }
+		void storeHalf(uint16_t* p) const { storeHalfLanes(*this, p); }
+		static Float loadBytes(const uint8_t* p) { return loadByteLanes<Float>(p); }
+		void storeBytes(uint8_t* p) const { storeByteLanes(*this, p); }
+
+		friend Float operator+(Float a, Float b) { return _mm_add_ps(a.v, b.v); }
+		friend Float operator-(Float a, Float b) { return _mm_sub_ps(a.v, b.v); }
+		friend Float operator*(Float a, Float b) { return _mm_mul_ps(a.v, b.v); }
+		friend Float operator/(Float a, Float b) { return _mm_div_ps(a.v, b.v); }
+		friend Float min(Float a, Float b) { return _mm_min_ps(a.v, b.v); }
+		friend Float max(Float a, Float b) { return _mm_max_ps(a.v, b.v); }
+		friend Float sqrt(Float a) { return _mm_sqrt_ps(a.v); }
+		friend Float rsqrt(Float a) { return _mm_rsqrt_ps(a.v); }
+		friend Mask lessThan(Float a, Float b) { return _mm_cmplt_ps(a.v, b.v); }
+		friend Mask greaterThan(Float a, Float b) { return _mm_cmpgt_ps(a.v, b.v); }
+		static Mask maskAnd(Mask a, Mask b) { return _mm_and_ps(a, b); }
+		// SSE2 has no blendv
+		friend Float select(Mask m, Float a, Float b) { return _mm_or_ps(_mm_and_ps(m, a.v), _mm_andnot_ps(m, b.v)); }
+		static uint32_t toBits(Mask m) { return static_cast<uint32_t>(_mm_movemask_ps(m)); }
+		friend float reduceAdd(Float a)
+		{
+			const __m128 sum_2 = _mm_add_ps(a.v, _mm_movehl_ps(a.v, a.v));
+			return _mm_cvtss_f32(_mm_add_ss(sum_2, _mm_shuffle_ps(sum_2, sum_2, 1)));
+		}
+		friend float reduceMax(Float a)
+		{
+			const __m128 max_2 = _mm_max_ps(a.v, _mm_movehl_ps(a.v, a.v));
+			return _mm_cvtss_f32(_mm_max_ss(max_2, _mm_shuffle_ps(max_2, max_2, 1)));
+		}
+	};
+#else
+	using Float = Scalar;
+#endif
+
+	constexpr uint32_t width = Float::width;
+
+	// approximated 1 / sqrt(a) refined with one Newton-Raphson step, close to full float precision
+	template<typename TFloat>
+	TFloat invSqrt(TFloat a)
+	{
+		const TFloat y = rsqrt(a);
+		return y * (TFloat::broadcast(1.5f) - TFloat::broadcast(0.5f) * a * y * y);
+	}
+}
+#endif // !SIMD_H
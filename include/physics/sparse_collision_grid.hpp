@@ -0,0 +1,325 @@
+#ifndef SPARSECOLLISIONGRID_H
+#define SPARSECOLLISIONGRID_H
+
+#include "collision_grid.hpp"
+#include "radix_sort.hpp"
+
+// grid only storing its occupied cells, same interface as CollisionGrid
+// memory and build cost depend on the atoms count instead of the world area
+// atoms are radix sorted by cell index then occupied cells are found through an open addressing hash table
+// cell indices are the dense ones (x * height + y) so width * height has to fit in 32 bits
+struct SparseCollisionGrid : public GridLayout
+{
+	// elements processed by one compaction task
+	static constexpr uint32_t chunk_size = 4096;
+	static constexpr uint32_t empty_key = 0xFFFFFFFF;
+
+	std::vector<uint32_t> atoms;
+	// cell of each object, invalid_cell when outside of the grid safety border
+	std::vector<uint32_t> atom_cell;
+	// occupied cells sorted by index, the atoms of cell c are atoms[cell_start[c]] to atoms[cell_start[c + 1]]
+	std::vector<uint32_t> cell_key;
+	std::vector<uint32_t> cell_start;
+	// occupied columns sorted by x
+	std::vector<GridColumn> columns;
+	// cell index to occupied cell table
+	std::vector<std::atomic<uint32_t>> table_key;
+	std::vector<uint32_t> table_cell;
+	uint32_t table_bits = 0;
+	// build buffers
+	std::vector<uint32_t> sort_key;
+	RadixSort sorter;
+	std::vector<uint32_t> heads;
+	std::vector<uint32_t> chunk_offset;
+
+	SparseCollisionGrid() = default;
+
+	SparseCollisionGrid(int32_t width_, int32_t height_)
+		: SparseCollisionGrid(GridLayout{ width_, height_, 1.0f, 0.0f, 0.0f })
+	{ }
+
+	explicit
+		SparseCollisionGrid(const GridLayout& layout)
+		: GridLayout{ layout }
+	{ }
+
+	static SparseCollisionGrid createLevel(IVec2 world_size, float cell_size, float min_radius)
+	{
+		return SparseCollisionGrid{ GridLayout::createLevel(world_size, cell_size, min_radius) };
+	}
+
+	[[nodiscard]]
+	CollisionCell getCell(int32_t x, int32_t y) const
+	{
+		if (x < 0 || x >= width || y < 0 || y >= height)
+		{
+			return {};
+		}
+		const uint32_t cell = findCell(to<uint32_t>(x * height + y));
+		if (cell == invalid_cell)
+		{
+			return {};
+		}
+		return { atoms.data() + cell_start[cell], cell_start[cell + 1] - cell_start[cell] };
+	}
+
+	// range of columns that can contain atoms
+	[[nodiscard]]
+	int32_t getColumnsBegin() const
+	{
+		return columns.empty() ? 0 : columns.front().x;
+	}
+
+	[[nodiscard]]
+	int32_t getColumnsEnd() const
+	{
+		return columns.empty() ? 0 : columns.back().x + 1;
+	}
+
+	// calls callback(const GridColumn&) for each non empty column in [x_begin, x_end)
+	template<typename TCallback>
+	void forEachColumn(int32_t x_begin, int32_t x_end, TCallback&& callback) const
+	{
+		auto it = std::lower_bound(columns.begin(), columns.end(), x_begin, [](const GridColumn& column, int32_t x) {
+			return column.x < x;
+		});
+		for (; it != columns.end() && it->x < x_end; ++it)
+		{
+			callback(*it);
+		}
+	}
+
+	void clear()
+	{
+		atoms.clear();
+		atom_cell.clear();
+		cell_key.clear();
+		cell_start.clear();
+		columns.clear();
+		table_bits = 0;
+	}
+
+	// parallel radix sort of the objects of this grid size class by cell
+	void build(const float* position_x, const float* position_y, const float* radius, uint32_t objects_count, tp::ThreadPool& thread_pool)
+	{
+		beginBuild(objects_count, thread_pool);
+		thread_pool.dispatch(objects_count, [&](uint32_t start, uint32_t end) {
+			bin(position_x, position_y, radius, start, end);
+		});
+		endBuild(objects_count, thread_pool);
+	}
+
+	// build steps, bin can be called concurrently on disjoint ranges covering [0, objects_count)
+	void beginBuild(uint32_t objects_count, tp::ThreadPool&)
+	{
+		atom_cell.resize(objects_count);
+		atoms.resize(objects_count);
+		sort_key.resize(objects_count);
+	}
+
+	void bin(const float* position_x, const float* position_y, const float* radius, uint32_t start, uint32_t end)
+	{
+		// objects outside of the grid get the first key past the last cell to be sorted last
+		const uint32_t outside_key = getCellsCount();
+		for (uint32_t i{start}; i < end; ++i)
+		{
+			const uint32_t cell = holds(radius[i]) ? getCellIndex(position_x[i], position_y[i]) : invalid_cell;
+			atom_cell[i] = cell;
+			sort_key[i] = cell == invalid_cell ? outside_key : cell;
+			atoms[i] = i;
+		}
+	}
+
+	void endBuild(uint32_t, tp::ThreadPool& thread_pool)
+	{
+		const uint32_t outside_key = getCellsCount();
+		sorter.sort(sort_key, atoms, outside_key, thread_pool);
+		atoms.resize(std::lower_bound(sort_key.begin(), sort_key.end(), outside_key) - sort_key.begin());
+		buildCells(thread_pool);
+		buildColumns(thread_pool);
+		buildTable(thread_pool);
+	}
+
+	// nothing to do, the radix sort is stable and its chunks do not depend on the threads count
+	void sortCells(tp::ThreadPool&)
+	{ }
+
+	// follows a ParticleStore::reorder using the grid order (atoms first then objects outside of the grid)
+	void applyOrder(const std::vector<uint32_t>& order, tp::ThreadPool& thread_pool)
+	{
+		std::vector<uint32_t> new_atom_cell(atom_cell.size());
+		thread_pool.dispatch(to<uint32_t>(order.size()), [&](uint32_t start, uint32_t end) {
+			for (uint32_t i{start}; i < end; ++i)
+			{
+				new_atom_cell[i] = atom_cell[order[i]];
+			}
+		});
+		std::swap(atom_cell, new_atom_cell);
+		thread_pool.dispatch(to<uint32_t>(atoms.size()), [&](uint32_t start, uint32_t end) {
+			for (uint32_t i{start}; i < end; ++i)
+			{
+				atoms[i] = i;
+			}
+		});
+	}
+
+	[[nodiscard]]
+	uint32_t findCell(uint32_t key) const
+	{
+		if (!table_bits)
+		{
+			return invalid_cell;
+		}
+		const uint32_t mask = (1u << table_bits) - 1u;
+		for (uint32_t slot{hash(key)};; slot = (slot + 1) & mask)
+		{
+			const uint32_t slot_key = table_key[slot].load(std::memory_order_relaxed);
+			if (slot_key == key)
+			{
+				return table_cell[slot];
+			}
+			if (slot_key == empty_key)
+			{
+				return invalid_cell;
+			}
+		}
+	}
+
+private:
+	// multiplicative hashing, the high bits are the best mixed ones
+	[[nodiscard]]
+	uint32_t hash(uint32_t key) const
+	{
+		return (key * 2654435769u) >> (32 - table_bits);
+	}
+
+	[[nodiscard]]
+	static uint32_t getChunkCount(uint32_t count)
+	{
+		return (count + chunk_size - 1) / chunk_size;
+	}
+
+	// writes to heads the indices i in [0, count) for which is_head(i) is true, in order
+	template<typename TPredicate>
+	uint32_t compactHeads(uint32_t count, TPredicate&& is_head, tp::ThreadPool& thread_pool)
+	{
+		const uint32_t chunk_count = getChunkCount(count);
+		chunk_offset.resize(chunk_count + 1);
+		thread_pool.dispatch(chunk_count, [&](uint32_t start, uint32_t end) {
+			for (uint32_t c{start}; c < end; ++c)
+			{
+				const uint32_t last = std::min(count, (c + 1) * chunk_size);
+				uint32_t heads_count = 0;
+				for (uint32_t i{c * chunk_size}; i < last; ++i)
+				{
+					heads_count += is_head(i);
+				}
+				chunk_offset[c + 1] = heads_count;
+			}
+		});
+		chunk_offset[0] = 0;
+		for (uint32_t c{0}; c < chunk_count; ++c)
+		{
+			chunk_offset[c + 1] += chunk_offset[c];
+		}
+		heads.resize(chunk_offset[chunk_count]);
+		thread_pool.dispatch(chunk_count, [&](uint32_t start, uint32_t end) {
+			for (uint32_t c{start}; c < end; ++c)
+			{
+				const uint32_t last = std::min(count, (c + 1) * chunk_size);
+				uint32_t slot = chunk_offset[c];
+				for (uint32_t i{c * chunk_size}; i < last; ++i)
+				{
+					if (is_head(i))
+					{
+						heads[slot++] = i;
+					}
+				}
+			}
+		});
+		return chunk_offset[chunk_count];
+	}
+
+	// one cell per run of atoms with the same key
+	void buildCells(tp::ThreadPool& thread_pool)
+	{
+		const uint32_t atoms_count = to<uint32_t>(atoms.size());
+		const uint32_t cells_count = compactHeads(atoms_count, [this](uint32_t i) {
+			return i == 0 || sort_key[i] != sort_key[i - 1];
+		}, thread_pool);
+		cell_key.resize(cells_count);
+		cell_start.resize(cells_count + 1);
+		thread_pool.dispatch(cells_count, [&](uint32_t start, uint32_t end) {
+			for (uint32_t c{start}; c < end; ++c)
+			{
+				cell_start[c] = heads[c];
+				cell_key[c] = sort_key[heads[c]];
+			}
+		});
+		cell_start[cells_count] = atoms_count;
+	}
+
+	// one column per run of cells with the same x
+	void buildColumns(tp::ThreadPool& thread_pool)
+	{
+		const uint32_t cells_count = to<uint32_t>(cell_key.size());
+		const uint32_t h = to<uint32_t>(height);
+		const uint32_t columns_count = compactHeads(cells_count, [this, h](uint32_t c) {
+			return c == 0 || cell_key[c] / h != cell_key[c - 1] / h;
+		}, thread_pool);
+		columns.resize(columns_count);
+		thread_pool.dispatch(columns_count, [&](uint32_t start, uint32_t end) {
+			for (uint32_t i{start}; i < end; ++i)
+			{
+				const uint32_t first_cell = heads[i];
+				const uint32_t last_cell = (i + 1 < columns_count ? heads[i + 1] : cells_count) - 1;
+				columns[i] = {
+					to<int32_t>(cell_key[first_cell] / h),
+					to<int32_t>(cell_key[first_cell] % h),
+					to<int32_t>(cell_key[last_cell] % h),
+					cell_start[first_cell],
+					cell_start[last_cell + 1]
+				};
+			}
+		});
+	}
+
+	// the table is at least twice as large as the occupied cells count, keys are unique
+	void buildTable(tp::ThreadPool& thread_pool)
+	{
+		const uint32_t cells_count = to<uint32_t>(cell_key.size());
+		table_bits = 4;
+		while ((1u << table_bits) < 2 * cells_count)
+		{
+			++table_bits;
+		}
+		const uint32_t table_size = 1u << table_bits;
+		if (table_key.size() < table_size)
+		{
+			std::vector<std::atomic<uint32_t>>(table_size).swap(table_key);
+			table_cell.resize(table_size);
+		}
+		thread_pool.dispatch(table_size, [&](uint32_t start, uint32_t end) {
+			for (uint32_t i{start}; i < end; ++i)
+			{
+				table_key[i].store(empty_key, std::memory_order_relaxed);
+			}
+		});
+		const uint32_t mask = table_size - 1;
+		thread_pool.dispatch(cells_count, [&](uint32_t start, uint32_t end) {
+			for (uint32_t c{start}; c < end; ++c)
+			{
+				for (uint32_t slot{hash(cell_key[c])};; slot = (slot + 1) & mask)
+				{
+					uint32_t expected = empty_key;
+					if (table_key[slot].compare_exchange_strong(expected, cell_key[c], std::memory_order_relaxed))
+					{
+						table_cell[slot] = c;
+						break;
+					}
+				}
+			}
+		});
+	}
+};
+#endif // !SPARSECOLLISIONGRID_H
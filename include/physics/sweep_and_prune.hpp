@@ -0,0 +1,189 @@
+#ifndef SWEEPANDPRUNE_H
+#define SWEEPANDPRUNE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "verlet_lists.hpp"
+#include "collision_grid.hpp"
+#include "radix_sort.hpp"
+#include "engine/common/utils.hpp"
+#include "thread_pool/thread_pool.hpp"
+
+// verlet lists of the unit size class found by sweep and prune: atoms are radix sorted along the longest side of
+// their bounds, then each atom sweeps the atoms after it until they are too far along the axis to touch it
+// unlike the grid the cost does not depend on the area covered by the atoms, long thin layouts like streams
+// only sort their atoms along their length
+// a pair is stored by its first atom in the sorted order, pairs are solved by slabs along the axis, a slab being
+// wider than any pair so that even slabs, then odd ones, are independent
+struct SweepAndPrune : public VerletLists
+{
+	// elements processed by one bounds task
+	static constexpr uint32_t chunk_size = 4096;
+	// sort keys are the coordinates along the axis in steps of 1 / key_resolution units
+	static constexpr float key_resolution = 64.0f;
+	// the unit grid is only needed if other levels look into it
+	static constexpr bool uses_grid = false;
+
+	// 0 sorts along x, 1 along y
+	uint32_t axis = 0;
+	// atoms of the size class sorted along the axis, slot k holds atoms[k]
+	std::vector<uint32_t> atoms;
+	std::vector<uint32_t> sort_key;
+	// keys spanned by a slab, and first slot of each slab
+	uint32_t slab_keys = 1;
+	std::vector<uint32_t> slab_start;
+	std::vector<uint8_t> slab_awake;
+	// build buffers
+	RadixSort sorter;
+	Vec2 bounds_min;
+	Vec2 bounds_max;
+	std::vector<Vec2> chunk_min;
+	std::vector<Vec2> chunk_max;
+
+	// only the objects the layout holds are sorted, its max_radius bounds the sweep
+	void build(const ParticleStore& objects, const GridLayout& layout, tp::ThreadPool& thread_pool)
+	{
+		const auto objects_count = to<uint32_t>(objects.size());
+		const float max_reach = 2.0f * layout.max_radius + skin;
+		slab_keys = std::max(to<uint32_t>(std::ceil(max_reach * key_resolution)), 1u);
+		updateBounds(objects, layout, thread_pool);
+		axis = bounds_max.x - bounds_min.x >= bounds_max.y - bounds_min.y ? 0 : 1;
+		const float axis_min = axis ? bounds_min.y : bounds_min.x;
+		const float extent = std::max(axis ? bounds_max.y - bounds_min.y : bounds_max.x - bounds_min.x, 0.0f);
+		const uint32_t slabs_count = to<uint32_t>(extent * key_resolution) / slab_keys + 1;
+		// objects out of the size class get the first key past the last slab to be sorted last
+		const uint32_t outside_key = slabs_count * slab_keys;
+		const float* coordinate = axis ? objects.position_y.data() : objects.position_x.data();
+		atoms.resize(objects_count);
+		sort_key.resize(objects_count);
+		thread_pool.dispatch(objects_count, [&](uint32_t start, uint32_t end) {
+			for (uint32_t i{start}; i < end; ++i)
+			{
+				atoms[i] = i;
+				sort_key[i] = layout.holds(objects.radius[i]) ? std::min(to<uint32_t>((coordinate[i] - axis_min) * key_resolution), outside_key - 1) : outside_key;
+			}
+		});
+		sorter.sort(sort_key, atoms, outside_key, thread_pool);
+		atoms.resize(std::lower_bound(sort_key.begin(), sort_key.end(), outside_key) - sort_key.begin());
+		buildSlabs(slabs_count, thread_pool);
+		buildLists(objects, to<uint32_t>(atoms.size()), thread_pool, [&](uint32_t slot, auto&& callback) {
+			forEachCandidate(objects, layout, slot, callback);
+		});
+	}
+
+	// even slabs then odd ones, a slab is solved if it or the next one holds an awake atom
+	template<typename TGrid, typename TCallback>
+	void forEachPair(const ParticleStore& objects, const TGrid&, float sleep_steps, int32_t, tp::ThreadPool& thread_pool, TCallback&& solve_pair)
+	{
+		const auto slabs_count = to<uint32_t>(slab_start.size()) - 1;
+		slab_awake.assign(slabs_count + 1, 0);
+		thread_pool.dispatch(slabs_count, [&](uint32_t start, uint32_t end) {
+			for (uint32_t s{start}; s < end; ++s)
+			{
+				for (uint32_t k{slab_start[s]}; k < slab_start[s + 1] && !slab_awake[s]; ++k)
+				{
+					slab_awake[s] = objects.isAwake(atoms[k], sleep_steps);
+				}
+			}
+		});
+		const uint32_t thread_count = thread_pool.thread_count_;
+		for (uint32_t pass{0}; pass < iterations; ++pass)
+		{
+			for (uint32_t parity{0}; parity < 2; ++parity)
+			{
+				std::atomic<uint32_t> next_slab{ parity };
+				const uint32_t task_count = std::min(thread_count, (slabs_count + 1 - parity) / 2);
+				for (uint32_t t{0}; t < task_count; ++t)
+				{
+					thread_pool.addTask([&] {
+						for (uint32_t s{next_slab.fetch_add(2)}; s < slabs_count; s = next_slab.fetch_add(2))
+						{
+							if (slab_awake[s] | slab_awake[s + 1])
+							{
+								forEachSlotPair(atoms.data(), slab_start[s], slab_start[s + 1], solve_pair);
+							}
+						}
+					});
+				}
+				thread_pool.waitForCompletion();
+			}
+		}
+	}
+
+private:
+	[[nodiscard]]
+	static uint32_t getChunkCount(uint32_t count)
+	{
+		return (count + chunk_size - 1) / chunk_size;
+	}
+
+	// bounds of the objects of the size class, reduced by chunks
+	void updateBounds(const ParticleStore& objects, const GridLayout& layout, tp::ThreadPool& thread_pool)
+	{
+		const auto objects_count = to<uint32_t>(objects.size());
+		const uint32_t chunk_count = getChunkCount(objects_count);
+		chunk_min.resize(chunk_count);
+		chunk_max.resize(chunk_count);
+		thread_pool.dispatch(chunk_count, [&](uint32_t start, uint32_t end) {
+			for (uint32_t c{start}; c < end; ++c)
+			{
+				Vec2 min_corner = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+				Vec2 max_corner = { -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() };
+				const uint32_t last = std::min(objects_count, (c + 1) * chunk_size);
+				for (uint32_t i{c * chunk_size}; i < last; ++i)
+				{
+					if (layout.holds(objects.radius[i]))
+					{
+						min_corner = { std::min(min_corner.x, objects.position_x[i]), std::min(min_corner.y, objects.position_y[i]) };
+						max_corner = { std::max(max_corner.x, objects.position_x[i]), std::max(max_corner.y, objects.position_y[i]) };
+					}
+				}
+				chunk_min[c] = min_corner;
+				chunk_max[c] = max_corner;
+			}
+		});
+		bounds_min = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+		bounds_max = { -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() };
+		for (uint32_t c{0}; c < chunk_count; ++c)
+		{
+			bounds_min = { std::min(bounds_min.x, chunk_min[c].x), std::min(bounds_min.y, chunk_min[c].y) };
+			bounds_max = { std::max(bounds_max.x, chunk_max[c].x), std::max(bounds_max.y, chunk_max[c].y) };
+		}
+	}
+
+	// slab s holds the keys [s * slab_keys, (s + 1) * slab_keys)
+	void buildSlabs(uint32_t slabs_count, tp::ThreadPool& thread_pool)
+	{
+		const auto keys_end = sort_key.begin() + to<int64_t>(atoms.size());
+		slab_start.resize(slabs_count + 1);
+		thread_pool.dispatch(slabs_count, [&](uint32_t start, uint32_t end) {
+			for (uint32_t s{start}; s < end; ++s)
+			{
+				slab_start[s] = to<uint32_t>(std::lower_bound(sort_key.begin(), keys_end, s * slab_keys) - sort_key.begin());
+			}
+		});
+		slab_start[slabs_count] = to<uint32_t>(atoms.size());
+	}
+
+	// atoms after this one in the sorted order until their keys are farther than the largest reach of a pair
+	// with it, a key being the floor of the coordinate its distance along the axis is at most reach keys rounded up
+	template<typename TCallback>
+	void forEachCandidate(const ParticleStore& objects, const GridLayout& layout, uint32_t slot, TCallback&& callback) const
+	{
+		const uint32_t atom = atoms[slot];
+		const auto window = to<uint32_t>(std::ceil((objects.radius[atom] + layout.max_radius + skin) * key_resolution));
+		const uint32_t key = sort_key[slot];
+		for (uint32_t k{slot + 1}; k < atoms.size() && sort_key[k] - key <= window; ++k)
+		{
+			if (isCandidate(objects, atom, atoms[k]))
+			{
+				callback(atoms[k]);
+			}
+		}
+	}
+};
+#endif // !SWEEPANDPRUNE_H
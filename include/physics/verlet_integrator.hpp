@@ -0,0 +1,125 @@
+#ifndef VERLETINTEGRATOR_H
+#define VERLETINTEGRATOR_H
+
+#include "simd.hpp"
+#include "particle_store.hpp"
+
+// branchless vectorized version of PhysicObject::update followed by the world borders clamp
+// also tracks rest: objects slower than sleep_speed for sleep_steps substeps fall asleep and stop
+// being integrated until contacts move them faster than wake_speed
+struct VerletIntegrator
+{
+	struct Parameters
+	{
+		Vec2 gravity;
+		// world borders, object centers are kept one radius away from them
+		Vec2 min_position;
+		Vec2 max_position;
+		float dt;
+		// distances per step
+		float sleep_speed;
+		float wake_speed;
+		float sleep_steps;
+		// optional per object accelerations added to the gravity, aligned like the positions
+		const float* acceleration_x = nullptr;
+		const float* acceleration_y = nullptr;
+	};
+
+	template<typename TFloat>
+	static void integrateAt(ParticleStore& objects, uint64_t i, const Parameters& parameters)
+	{
+		const float* radius = objects.radius.data() + i;
+
+		const TFloat dt2 = TFloat::broadcast(parameters.dt * parameters.dt);
+		const TFloat damping = TFloat::broadcast(PhysicObject::velocity_damping);
+		const TFloat zero = TFloat::broadcast(0.0f);
+		const TFloat one = TFloat::broadcast(1.0f);
+		const TFloat sleep_steps = TFloat::broadcast(parameters.sleep_steps);
+		const TFloat max_rest = TFloat::broadcast(std::min(parameters.sleep_steps, ParticleStore::max_rest_steps));
+
+		const TFloat x = TFloat::load(objects.position_x.data() + i);
+		const TFloat y = TFloat::load(objects.position_y.data() + i);
+		const TFloat move_x = objects.loadVelocityX<TFloat>(i);
+		const TFloat move_y = objects.loadVelocityY<TFloat>(i);
+		// rest tracking, a sleeping object only moves when pushed by contacts
+		const TFloat speed2 = move_x * move_x + move_y * move_y;
+		const TFloat rest = objects.loadRestSteps<TFloat>(i);
+		const typename TFloat::Mask sleeping = TFloat::maskAnd(
+			greaterThan(rest, sleep_steps - one),
+			lessThan(speed2, TFloat::broadcast(parameters.wake_speed * parameters.wake_speed))
+		);
+		const typename TFloat::Mask slow = lessThan(speed2, TFloat::broadcast(parameters.sleep_speed * parameters.sleep_speed));
+		objects.storeRestSteps(i, select(sleeping, rest, select(slow, min(rest + one, max_rest), zero)));
+		// sleeping objects stay in place, nothing else to write when the whole block sleeps
+		if (TFloat::toBits(sleeping) == (1u << TFloat::width) - 1u)
+		{
+			objects.storeRest(i, x, y);
+			return;
+		}
+		TFloat acc_x = TFloat::broadcast(parameters.gravity.x);
+		TFloat acc_y = TFloat::broadcast(parameters.gravity.y);
+		if (parameters.acceleration_x)
+		{
+			acc_x = acc_x + TFloat::load(parameters.acceleration_x + i);
+			acc_y = acc_y + TFloat::load(parameters.acceleration_y + i);
+		}
+		// apply verlet integration
+		const TFloat new_x = x + move_x + (acc_x - move_x * damping) * dt2;
+		const TFloat new_y = y + move_y + (acc_y - move_y * damping) * dt2;
+		// apply map borders collisions
+		const TFloat r = TFloat::load(radius);
+		const TFloat clamped_x = min(max(new_x, TFloat::broadcast(parameters.min_position.x) + r), TFloat::broadcast(parameters.max_position.x) - r);
+		const TFloat clamped_y = min(max(new_y, TFloat::broadcast(parameters.min_position.y) + r), TFloat::broadcast(parameters.max_position.y) - r);
+		objects.storeStep(i, x, y, select(sleeping, x, clamped_x), select(sleeping, y, clamped_y));
+	}
+
+	// squared distance travelled during the last step
+	template<typename TFloat>
+	static TFloat getDisplacement2At(const ParticleStore& objects, uint64_t i)
+	{
+		const TFloat move_x = objects.loadVelocityX<TFloat>(i);
+		const TFloat move_y = objects.loadVelocityY<TFloat>(i);
+		return move_x * move_x + move_y * move_y;
+	}
+
+	// start has to be a multiple of simd::width to keep loads aligned
+	static float getMaxDisplacement2(const ParticleStore& objects, uint64_t start, uint64_t end)
+	{
+		uint64_t i{ start };
+		simd::Float max_displacement2 = simd::Float::broadcast(0.0f);
+		for (; i + simd::width <= end; i += simd::width)
+		{
+			max_displacement2 = max(max_displacement2, getDisplacement2At<simd::Float>(objects, i));
+		}
+		float result = reduceMax(max_displacement2);
+		for (; i < end; ++i)
+		{
+			result = std::max(result, getDisplacement2At<simd::Scalar>(objects, i).v);
+		}
+		return result;
+	}
+
+	// scales the implicit velocities, needed when the time step changes
+	static void scaleVelocity(ParticleStore& objects, uint64_t start, uint64_t end, float ratio)
+	{
+		for (uint64_t i{ start }; i < end; ++i)
+		{
+			objects.setVelocity(i, objects.getVelocity(i) * ratio);
+		}
+	}
+
+	// start has to be a multiple of simd::width to keep loads aligned
+	static void integrate(ParticleStore& objects, uint64_t start, uint64_t end, const Parameters& parameters)
+	{
+		uint64_t i{ start };
+		for (; i + simd::width <= end; i += simd::width)
+		{
+			integrateAt<simd::Float>(objects, i, parameters);
+		}
+		for (; i < end; ++i)
+		{
+			integrateAt<simd::Scalar>(objects, i, parameters);
+		}
+	}
+};
+#endif // !VERLETINTEGRATOR_H
@@ -0,0 +1,126 @@
+#ifndef VERLETLISTS_H
+#define VERLETLISTS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "chunked_reduction.hpp"
+#include "particle_store.hpp"
+#include "engine/common/utils.hpp"
+#include "thread_pool/thread_pool.hpp"
+
+// candidate lists shared by the neighbor lists broadphases, the candidates of an atom are the atoms closer than their
+// radii sum plus skin when the lists are built, they hold every contact until one object has moved more than half
+// the skin since then
+// lists are stored in slots, the order a broadphase sorts its atoms in: the candidates of slot k are
+// neighbors[neighbor_start[k]] to neighbors[neighbor_start[k + 1]], a pair is only stored by one of its atoms
+// a broadphase derives from it and provides, for the solver it is plugged in:
+// - uses_grid, true if build needs the unit grid built at the current positions
+// - build(objects, grid, thread_pool) to find the lists, isOutdated telling when they have to be built again
+// - forEachPair(objects, grid, sleep_steps, tile_size, thread_pool, solve_pair) to solve the pairs of awake atoms,
+//   pairs given at the same time to different threads share no atom
+struct VerletLists
+{
+	// larger lists last longer, at most 1 for the unit size class
+	float skin = 0.5f;
+	// solving passes over the pairs per substep, the grid kernel meets each pair twice and a single pass lets
+	// dense piles heat up
+	uint32_t iterations = 2;
+	std::vector<uint32_t> neighbor_start;
+	std::vector<uint32_t> neighbors;
+	// objects positions when the lists were built
+	std::vector<float> build_position_x;
+	std::vector<float> build_position_y;
+	ChunkedReduction reduction;
+	// lists built since the start, to tune the skin
+	uint64_t builds_count = 0;
+
+	// true if an object may have come closer than its radii sum plus skin to one of its non candidates
+	[[nodiscard]]
+	bool isOutdated(const ParticleStore& objects, tp::ThreadPool& thread_pool)
+	{
+		const auto objects_count = to<uint32_t>(objects.size());
+		if (build_position_x.size() != objects_count)
+		{
+			return true;
+		}
+		const float max_displacement2 = reduction.getMax(objects_count, thread_pool, [&](uint32_t start, uint32_t end) {
+			return getMaxMove2(objects, start, end);
+		});
+		const float max_displacement = 0.5f * skin;
+		return max_displacement2 > max_displacement * max_displacement;
+	}
+
+protected:
+	// for_each_candidate(slot, callback) calls callback(candidate) for each candidate stored by a slot
+	// the candidates are counted first then written
+	template<typename TCandidates>
+	void buildLists(const ParticleStore& objects, uint32_t slots_count, tp::ThreadPool& thread_pool, TCandidates&& for_each_candidate)
+	{
+		neighbor_start.resize(slots_count + 1);
+		thread_pool.dispatch(slots_count, [&](uint32_t start, uint32_t end) {
+			for (uint32_t k{start}; k < end; ++k)
+			{
+				uint32_t count = 0;
+				for_each_candidate(k, [&count](uint32_t) { ++count; });
+				neighbor_start[k] = count;
+			}
+		});
+		// exclusive prefix sum of the candidates counts
+		neighbor_start[slots_count] = reduction.exclusiveScan(slots_count, thread_pool, [&](uint32_t k) {
+			return neighbor_start[k];
+		}, [&](uint32_t k, uint32_t offset) {
+			neighbor_start[k] = offset;
+		});
+		neighbors.resize(neighbor_start[slots_count]);
+		thread_pool.dispatch(slots_count, [&](uint32_t start, uint32_t end) {
+			for (uint32_t k{start}; k < end; ++k)
+			{
+				uint32_t next = neighbor_start[k];
+				for_each_candidate(k, [&](uint32_t candidate) { neighbors[next++] = candidate; });
+			}
+		});
+		build_position_x.assign(objects.position_x.begin(), objects.position_x.begin() + objects.size());
+		build_position_y.assign(objects.position_y.begin(), objects.position_y.begin() + objects.size());
+		++builds_count;
+	}
+
+	// candidate test shared by the broadphases
+	[[nodiscard]]
+	bool isCandidate(const ParticleStore& objects, uint32_t atom_1, uint32_t atom_2) const
+	{
+		const float dx = objects.position_x[atom_1] - objects.position_x[atom_2];
+		const float dy = objects.position_y[atom_1] - objects.position_y[atom_2];
+		const float reach = objects.radius[atom_1] + objects.radius[atom_2] + skin;
+		return dx * dx + dy * dy < reach * reach;
+	}
+
+	// calls callback(atom, candidate) for the pairs stored by slots [slot_begin, slot_end), atoms[k] is the atom of slot k
+	template<typename TCallback>
+	void forEachSlotPair(const uint32_t* atoms, uint32_t slot_begin, uint32_t slot_end, TCallback&& callback) const
+	{
+		for (uint32_t k{slot_begin}; k < slot_end; ++k)
+		{
+			for (uint32_t i{neighbor_start[k]}; i < neighbor_start[k + 1]; ++i)
+			{
+				callback(atoms[k], neighbors[i]);
+			}
+		}
+	}
+
+private:
+	// largest squared distance travelled since the lists were built by the objects in [start, end)
+	[[nodiscard]]
+	float getMaxMove2(const ParticleStore& objects, uint32_t start, uint32_t end) const
+	{
+		float max_move2 = 0.0f;
+		for (uint32_t i{start}; i < end; ++i)
+		{
+			const float move_x = objects.position_x[i] - build_position_x[i];
+			const float move_y = objects.position_y[i] - build_position_y[i];
+			max_move2 = std::max(max_move2, move_x * move_x + move_y * move_y);
+		}
+		return max_move2;
+	}
+};
+#endif // !VERLETLISTS_H
@@ -17,7 +17,7 @@ namespace tp
 		std::atomic<uint32_t> remaining_task_ = 0;
 
 		template<typename TCallback>
-		void addTask(TCallback& callback)
+		void addTask(TCallback&& callback)
 		{
 			std::lock_guard<std::mutex> lock_guard{ mutex_ };
 			task_.push(std::forward<TCallback>(callback));
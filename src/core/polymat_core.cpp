@@ -0,0 +1,10 @@
+#include "physics/physics.hpp"
+#include "physics/domain_solver.hpp"
+
+// the core is header only, the solvers are instantiated here so that the library
+// checks the whole core builds without SFML
+template struct GenericPhysicSolver<CollisionGrid>;
+template struct GenericPhysicSolver<SparseCollisionGrid>;
+template struct GenericPhysicSolver<CollisionGrid, SweepAndPrune>;
+template struct DomainSolver<CollisionGrid>;
+template struct DomainSolver<SparseCollisionGrid>;
@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/wait.h>
+#include "engine/common/color_utils.hpp"
+
+#include "physics/domain_solver.hpp"
+#include "thread_pool/thread_pool.hpp"
+
+// runs the headless scene split in vertical slabs, one process per slab, and reports each domain objects count
+// usage: polymat_domain [domains_count] [frames_count] [socket|shm]
+int main(int argc, char** argv)
+{
+	const auto domains_count = to<uint32_t>(argc > 1 ? std::max(std::strtoul(argv[1], nullptr, 10), 1ul) : 2);
+	const auto frames_count = to<uint32_t>(argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000);
+	const bool shared_memory = argc > 3 && std::string{ argv[3] } == "shm";
+	const uint64_t objects_count = 8000;
+
+	// sockets are created before forking so that each process inherits its ends
+	std::vector<std::pair<int, int>> socket_pairs;
+	for (uint32_t i{0}; !shared_memory && i + 1 < domains_count; ++i)
+	{
+		socket_pairs.push_back(SocketTransport::createPair());
+	}
+	uint32_t rank = 0;
+	for (uint32_t r{1}; r < domains_count; ++r)
+	{
+		if (fork() == 0)
+		{
+			rank = r;
+			break;
+		}
+	}
+	// the pair between rank and rank + 1 is socket_pairs[rank], each process closes the ends it does not use
+	std::unique_ptr<DomainTransport> previous;
+	std::unique_ptr<DomainTransport> next;
+	for (uint32_t i{0}; i < socket_pairs.size(); ++i)
+	{
+		if (i + 1 == rank)
+		{
+			previous = std::make_unique<SocketTransport>(socket_pairs[i].second);
+			close(socket_pairs[i].first);
+		}
+		else if (i == rank)
+		{
+			next = std::make_unique<SocketTransport>(socket_pairs[i].first);
+			close(socket_pairs[i].second);
+		}
+		else
+		{
+			close(socket_pairs[i].first);
+			close(socket_pairs[i].second);
+		}
+	}
+	if (shared_memory)
+	{
+		// segment names use the first process id, known by all the processes after fork, the lower rank owns it
+		const std::string prefix = "/polymat_domain_" + std::to_string(rank ? getppid() : getpid()) + "_";
+		if (rank)
+		{
+			previous = std::make_unique<SharedMemoryTransport>(prefix + std::to_string(rank - 1), false);
+		}
+		if (rank + 1 < domains_count)
+		{
+			next = std::make_unique<SharedMemoryTransport>(prefix + std::to_string(rank), true);
+		}
+	}
+
+	tp::ThreadPool thread_pool(std::max(std::thread::hardware_concurrency() / domains_count, 1u));
+	const IVec2 world_size{ 300, 300 };
+	PhysicSolver solver{ world_size, thread_pool };
+	DomainSolver<CollisionGrid> domain{ solver, DomainLayout{ 0, domains_count, rank, to<float>(world_size.x) }, previous.get(), next.get() };
+
+	// same emitter as the headless scene, objects flow from the first domain to the next ones
+	const float dt = 1.0f / 60.0f;
+	uint64_t emitted = 0;
+	using Clock = std::chrono::steady_clock;
+	const Clock::time_point start = Clock::now();
+	for (uint32_t frame{1}; frame <= frames_count; ++frame)
+	{
+		for (uint32_t i{20}; i-- && emitted < objects_count;)
+		{
+			const Vec2 position{ 2.0f, 10.0f + 1.0f * i };
+			++emitted;
+			if (domain.isOwned(position))
+			{
+				const civ::ID id = solver.createObject(position);
+				solver.objects[id].addVelocity({ 0.2f, 0.0f });
+				solver.objects[id].setColor(ColorUtils::getRainbow(to<float>(emitted) * 0.0001f));
+			}
+		}
+		domain.update(dt);
+	}
+	const double total_s = std::chrono::duration<double>(Clock::now() - start).count();
+	std::cout << "domain " << rank << " objects " << solver.objects.size() << ", "
+		<< frames_count / total_s << " frames/s" << std::endl;
+
+	// the first process reports a failure of any domain
+	int result = 0;
+	for (uint32_t r{1}; !rank && r < domains_count; ++r)
+	{
+		int status = 0;
+		wait(&status);
+		result |= !WIFEXITED(status) || WEXITSTATUS(status);
+	}
+	return result;
+}
@@ -0,0 +1,63 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include "engine/common/color_utils.hpp"
+
+#include "physics/physics.hpp"
+#include "thread_pool/thread_pool.hpp"
+
+// steps the solver as fast as possible, without window nor frame cap, and reports its throughput
+// usage: polymat_headless [objects_count] [frames_count] [threads_count]
+int main(int argc, char** argv)
+{
+	const auto objects_count = to<uint64_t>(argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 8000);
+	const auto frames_count = to<uint32_t>(argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 2000);
+	const auto threads_count = to<uint32_t>(argc > 3 ? std::strtoul(argv[3], nullptr, 10) : std::max(std::thread::hardware_concurrency(), 1u));
+
+	tp::ThreadPool thread_pool(threads_count);
+	const IVec2 world_size{ 300, 300 };
+	PhysicSolver solver{ world_size, thread_pool };
+
+	// same scene as the windowed app, the solver keeps its fixed 60 Hz time step
+	std::vector<Vec2> emitter_positions;
+	const float dt = 1.0f / 60.0f;
+	constexpr uint32_t report_interval = 100;
+	using Clock = std::chrono::steady_clock;
+	const Clock::time_point start = Clock::now();
+	Clock::time_point interval_start = start;
+	for (uint32_t frame{1}; frame <= frames_count; ++frame)
+	{
+		if (solver.objects.size() < objects_count)
+		{
+			emitter_positions.clear();
+			for (uint32_t i{20}; i--;)
+			{
+				emitter_positions.push_back({ 2.0f, 10.0f + 1.0f * i });
+			}
+			const ObjectBatch batch = solver.createObjects(emitter_positions);
+			for (uint64_t i{batch.first}; i < batch.first + batch.count; ++i)
+			{
+				solver.objects.getDataAt(i).addVelocity({ 0.2f, 0.0f });
+				solver.objects.getDataAt(i).setColor(ColorUtils::getRainbow(solver.objects.getID(i) * 0.0001f));
+			}
+		}
+
+		solver.update(dt);
+
+		if (frame % report_interval == 0 || frame == frames_count)
+		{
+			const Clock::time_point now = Clock::now();
+			const uint32_t interval_frames = frame % report_interval ? frame % report_interval : report_interval;
+			const double interval_ms = std::chrono::duration<double, std::milli>(now - interval_start).count();
+			std::cout << "frame " << frame << " objects " << solver.objects.size()
+				<< " ms/frame " << interval_ms / interval_frames << std::endl;
+			interval_start = now;
+		}
+	}
+	const double total_s = std::chrono::duration<double>(Clock::now() - start).count();
+	std::cout << frames_count << " frames in " << total_s << " s, "
+		<< frames_count / total_s << " frames/s with " << threads_count << " threads" << std::endl;
+	return 0;
+}
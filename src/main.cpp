@@ -36,17 +36,24 @@ int main()
 		app.setFramerateLimit(target_fps);
 	});
 
+	std::vector<Vec2> emitter_positions;
+
 	// main loop
 	const float dt = 1.0f / static_cast<float>(fps_cap);
 	while (app.run())
 	{
 		if (solver.objects.size() < 8000 && emit)
 		{
+			emitter_positions.clear();
 			for (uint32_t i{20}; i--;)
 			{
-				const auto id = solver.createObject({ 2.0f, 10.0f + 1.0f * i});
-				solver.objects[id].last_position.x -= 0.2f;
-				solver.objects[id].color = ColorUtils::getRainbow(id * 0.0001f);
+				emitter_positions.push_back({ 2.0f, 10.0f + 1.0f * i });
+			}
+			const ObjectBatch batch = solver.createObjects(emitter_positions);
+			for (uint64_t i{batch.first}; i < batch.first + batch.count; ++i)
+			{
+				solver.objects.getDataAt(i).addVelocity({ 0.2f, 0.0f });
+				solver.objects.getDataAt(i).setColor(ColorUtils::getRainbow(solver.objects.getID(i) * 0.0001f));
 			}
 		}
 
@@ -46,22 +46,23 @@ void Renderer::updateParticlesVA()
 	objects_va.resize(solver.objects.size() * 4);
 
 	const float texture_size = 1024.0f;
-	const float radius = 1.5f;
 	thread_pool.dispatch(to<uint32_t>(solver.objects.size()), [&](uint32_t start, uint32_t end) {
 		for (uint32_t i{ start }; i < end; ++i)
 		{
-			const PhysicObject& object = solver.objects.data[i];
+			const sf::Vector2f position = toSf(solver.objects.getPosition(i));
+			// default objects are drawn with a 1.5 radius
+			const float radius = 1.5f * solver.objects.radius[i] / PhysicObject::default_radius;
 			const uint32_t idx = i << 2;
-			objects_va[idx + 0].position = object.position + Vec2{ -radius, -radius };
-			objects_va[idx + 1].position = object.position + Vec2{ radius, -radius };
-			objects_va[idx + 2].position = object.position + Vec2{ radius, radius };
-			objects_va[idx + 3].position = object.position + Vec2{ -radius, radius };
+			objects_va[idx + 0].position = position + sf::Vector2f{ -radius, -radius };
+			objects_va[idx + 1].position = position + sf::Vector2f{ radius, -radius };
+			objects_va[idx + 2].position = position + sf::Vector2f{ radius, radius };
+			objects_va[idx + 3].position = position + sf::Vector2f{ -radius, radius };
 			objects_va[idx + 0].texCoords = { 0.0f, 0.0f };
 			objects_va[idx + 1].texCoords = { texture_size, 0.0f };
 			objects_va[idx + 2].texCoords = { texture_size, texture_size };
 			objects_va[idx + 3].texCoords = { 0.0f, texture_size };
 
-			const sf::Color color = object.color;
+			const sf::Color color = toSf(unpackColor(solver.objects.color[i]));
 			objects_va[idx + 0].color = color;
 			objects_va[idx + 1].color = color;
 			objects_va[idx + 2].color = color;